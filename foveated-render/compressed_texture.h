@@ -0,0 +1,520 @@
+#ifndef COMPRESSED_TEXTURE_H
+#define COMPRESSED_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "mapped_file.h"
+#include "stb_image.h"
+
+// Block encoders for the four formats textures are stored in, one 4x4 block
+// of 8 bit pixels at a time:
+//
+//     BC1 (DXT1)   RGB,  8 bytes per block
+//     BC3 (DXT5)   RGBA, BC1 colour plus a BC4 alpha block, 16 bytes per block
+//     BC4 (RGTC1)  one channel, 8 bytes per block
+//     BC5 (RGTC2)  two channels, a BC4 block each, 16 bytes per block
+//
+// Colour endpoints are the extremes of the block along its principal axis,
+// alpha and single channel endpoints its minimum and maximum; every pixel then
+// takes the closest palette entry. Fast enough to run on first load, not a
+// substitute for an exhaustive offline encoder.
+namespace BlockCompression
+{
+    inline uint16_t packRGB565(const float rgb[3])
+    {
+        int r = std::clamp((int)(rgb[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = std::clamp((int)(rgb[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = std::clamp((int)(rgb[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(uint16_t c, int rgb[3])
+    {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // BC1 block of 16 RGBA pixels (alpha ignored), always in four colour mode
+    inline void encodeBC1(const uint8_t pixels[64], uint8_t out[8])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += pixels[i * 4 + c] / 16.0f;
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+        {
+            float r = pixels[i * 4] - mean[0], g = pixels[i * 4 + 1] - mean[1], b = pixels[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+        // principal axis by power iteration, starting from the luminance direction
+        float axis[3] = { 0.299f, 0.587f, 0.114f };
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[3] = {
+                cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+            float length = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) });
+            if (length < 1e-6f)
+                break;
+            for (int c = 0; c < 3; ++c)
+                axis[c] = next[c] / length;
+        }
+
+        int lo = 0, hi = 0;
+        float loDot = 1e30f, hiDot = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float dot = pixels[i * 4] * axis[0] + pixels[i * 4 + 1] * axis[1] + pixels[i * 4 + 2] * axis[2];
+            if (dot < loDot) { loDot = dot; lo = i; }
+            if (dot > hiDot) { hiDot = dot; hi = i; }
+        }
+        // pull the endpoints in by 1/16 of their distance, the extremes are rarely worth a palette entry each
+        float e0[3], e1[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            float a = pixels[hi * 4 + c], b = pixels[lo * 4 + c];
+            float inset = (a - b) / 16.0f;
+            e0[c] = a - inset;
+            e1[c] = b + inset;
+        }
+        uint16_t c0 = packRGB565(e0), c1 = packRGB565(e1);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            int palette[4][3];
+            unpackRGB565(c0, palette[0]);
+            unpackRGB565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestError = 1 << 30;
+                for (int p = 0; p < 4; ++p)
+                {
+                    int dr = pixels[i * 4] - palette[p][0], dg = pixels[i * 4 + 1] - palette[p][1], db = pixels[i * 4 + 2] - palette[p][2];
+                    int error = dr * dr + dg * dg + db * db;
+                    if (error < bestError) { bestError = error; best = p; }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+        out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+        out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (uint8_t)(indices >> (i * 8));
+    }
+
+    // BC4 block of channel values 16 pixels apart by stride bytes, in eight value mode;
+    // also the alpha half of BC3
+    inline void encodeBC4(const uint8_t* values, int stride, uint8_t out[8])
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; ++i)
+        {
+            a0 = std::max(a0, (int)values[i * stride]);
+            a1 = std::min(a1, (int)values[i * stride]);
+        }
+
+        uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            int palette[8] = { a0, a1 };
+            for (int p = 2; p < 8; ++p)
+                palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestError = 256;
+                for (int p = 0; p < 8; ++p)
+                {
+                    int error = std::abs(values[i * stride] - palette[p]);
+                    if (error < bestError) { bestError = error; best = p; }
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+        out[0] = (uint8_t)a0;
+        out[1] = (uint8_t)a1;
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (uint8_t)(indices >> (i * 8));
+    }
+
+    inline void encodeBC3(const uint8_t pixels[64], uint8_t out[16])
+    {
+        encodeBC4(pixels + 3, 4, out);
+        encodeBC1(pixels, out + 8);
+    }
+
+    // red and green of 16 RGBA pixels
+    inline void encodeBC5(const uint8_t pixels[64], uint8_t out[16])
+    {
+        encodeBC4(pixels, 4, out);
+        encodeBC4(pixels + 1, 4, out + 8);
+    }
+
+    inline uint32_t blockBytes(uint32_t format)
+    {
+        return format == S3TC::COMPRESSED_RGBA_DXT5 || format == GL_COMPRESSED_RG_RGTC2 ? 16 : 8;
+    }
+
+    // size of a width x height level, partial blocks at the edges count as whole ones
+    inline uint32_t levelBytes(uint32_t format, uint32_t width, uint32_t height)
+    {
+        return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+}
+
+// Block compressed texture with its whole mip chain, as stored in a texture
+// cache file or as produced by compress(). The levels point either into the
+// mapped cache file or into the encoded bytes.
+struct CompressedImage
+{
+    struct Level
+    {
+        const uint8_t* data;
+        uint32_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    uint32_t format = 0;
+    std::vector<Level> levels;
+    std::vector<uint8_t> encoded;
+    MappedFile file;
+};
+
+// Texture cache files, written next to the source image as <image>.bctex so
+// later starts upload the blocks as they are instead of decoding, mipmapping
+// and letting the driver store the texture uncompressed. Little endian,
+// native struct layout:
+//
+//     Header
+//     LevelRecord[levelCount]         largest first, down to 1x1
+//     level blocks, 16 byte aligned, at the offsets of their records
+//
+// A cache is used while it is not older than its source and the source still
+// has the size it was written from, the rule the ORT model cache goes by.
+// The format follows the image's channels: 1 is BC4, 3 is BC1, 2 and 4 are
+// BC3 with grey expanded to RGB. Normal maps with more than one channel keep
+// only X and Y, in BC5, since BC1's shared 565 endpoints would lose most of
+// their precision; Z has to be rebuilt where they are sampled. A cache in
+// the other kind of format than the one asked for is not used.
+namespace TextureCache
+{
+    const char MAGIC[4] = { 'B', 'C', 'T', 'X' };
+    const uint32_t VERSION = 1;
+    const uint64_t ALIGNMENT = 16;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+    };
+
+    struct LevelRecord
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint32_t width;
+        uint32_t height;
+        uint32_t reserved;
+    };
+
+    static_assert(sizeof(Header) == 32 && sizeof(LevelRecord) == 24, "texture cache layout must not depend on padding");
+
+    inline std::string cachePath(const std::string& sourcePath)
+    {
+        return sourcePath + ".bctex";
+    }
+
+    inline uint64_t align(uint64_t offset)
+    {
+        return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    inline uint32_t format(int components, bool normalMap)
+    {
+        if (components == 1)
+            return GL_COMPRESSED_RED_RGTC1;
+        if (normalMap)
+            return GL_COMPRESSED_RG_RGTC2;
+        return components == 3 ? S3TC::COMPRESSED_RGB_DXT1 : S3TC::COMPRESSED_RGBA_DXT5;
+    }
+
+    // whether a cache in format can stand in for an image of this kind
+    inline bool matches(uint32_t format, bool normalMap)
+    {
+        return format == GL_COMPRESSED_RED_RGTC1 || (format == GL_COMPRESSED_RG_RGTC2) == normalMap;
+    }
+
+    // encode pixels with components channels and every mip level below them
+    inline void compress(const uint8_t* pixels, int width, int height, int components, bool normalMap, CompressedImage& image)
+    {
+        image.format = format(components, normalMap);
+
+        // levels are filtered from RGBA (or a single channel for BC4), one level at a time
+        const int channels = components == 1 ? 1 : 4;
+        std::vector<uint8_t> level((size_t)width * height * channels);
+        for (size_t i = 0; i < (size_t)width * height; ++i)
+        {
+            const uint8_t* source = pixels + i * components;
+            uint8_t* target = level.data() + i * channels;
+            if (components == 1)
+                target[0] = source[0];
+            else if (components == 2)
+                target[0] = target[1] = target[2] = source[0], target[3] = source[1];
+            else
+            {
+                target[0] = source[0];
+                target[1] = source[1];
+                target[2] = source[2];
+                target[3] = components == 4 ? source[3] : 255;
+            }
+        }
+
+        std::vector<std::pair<size_t, CompressedImage::Level>> offsets;
+        uint32_t w = (uint32_t)width, h = (uint32_t)height;
+        while (true)
+        {
+            CompressedImage::Level record = { nullptr, BlockCompression::levelBytes(image.format, w, h), w, h };
+            size_t offset = image.encoded.size();
+            image.encoded.resize(offset + record.size);
+            uint8_t* out = image.encoded.data() + offset;
+            for (uint32_t by = 0; by < h; by += 4)
+            {
+                for (uint32_t bx = 0; bx < w; bx += 4)
+                {
+                    // edge blocks repeat the last row and column
+                    uint8_t block[64];
+                    for (uint32_t y = 0; y < 4; ++y)
+                        for (uint32_t x = 0; x < 4; ++x)
+                        {
+                            size_t texel = (size_t)std::min(by + y, h - 1) * w + std::min(bx + x, w - 1);
+                            std::memcpy(block + (y * 4 + x) * channels, level.data() + texel * channels, channels);
+                        }
+                    if (image.format == GL_COMPRESSED_RED_RGTC1)
+                        BlockCompression::encodeBC4(block, 1, out);
+                    else if (image.format == S3TC::COMPRESSED_RGB_DXT1)
+                        BlockCompression::encodeBC1(block, out);
+                    else if (image.format == GL_COMPRESSED_RG_RGTC2)
+                        BlockCompression::encodeBC5(block, out);
+                    else
+                        BlockCompression::encodeBC3(block, out);
+                    out += BlockCompression::blockBytes(image.format);
+                }
+            }
+            offsets.push_back({ offset, record });
+            if (w == 1 && h == 1)
+                break;
+
+            // 2x2 box filter, an odd edge folds its last texel into the one before
+            uint32_t nw = std::max(w / 2, 1u), nh = std::max(h / 2, 1u);
+            std::vector<uint8_t> next((size_t)nw * nh * channels);
+            for (uint32_t y = 0; y < nh; ++y)
+                for (uint32_t x = 0; x < nw; ++x)
+                {
+                    uint32_t x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                    uint32_t y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+                    for (int c = 0; c < channels; ++c)
+                    {
+                        int sum = level[((size_t)y0 * w + x0) * channels + c] + level[((size_t)y0 * w + x1) * channels + c]
+                            + level[((size_t)y1 * w + x0) * channels + c] + level[((size_t)y1 * w + x1) * channels + c];
+                        next[((size_t)y * nw + x) * channels + c] = (uint8_t)((sum + 2) / 4);
+                    }
+                }
+            level.swap(next);
+            w = nw;
+            h = nh;
+        }
+
+        // the encoded bytes are complete, point the levels into them
+        image.levels.clear();
+        for (auto& entry : offsets)
+        {
+            entry.second.data = image.encoded.data() + entry.first;
+            image.levels.push_back(entry.second);
+        }
+    }
+
+    // map the cache of sourcePath, false if there is none, it is out of date or
+    // it is not in a format for this kind of image
+    inline bool read(const std::string& sourcePath, bool normalMap, CompressedImage& image)
+    {
+        std::error_code ec;
+        const std::string path = cachePath(sourcePath);
+        uint64_t sourceSize = std::filesystem::file_size(sourcePath, ec);
+        if (ec || std::filesystem::last_write_time(path, ec) < std::filesystem::last_write_time(sourcePath, ec) || ec)
+            return false;
+        if (!image.file.open(path))
+            return false;
+
+        const uint64_t size = image.file.size();
+        const uint8_t* data = image.file.data();
+        if (size < sizeof(Header))
+        {
+            image.file.close();
+            return false;
+        }
+        const Header& header = *(const Header*)data;
+        uint64_t tables = sizeof(Header) + (uint64_t)header.levelCount * sizeof(LevelRecord);
+        bool valid = std::memcmp(header.magic, MAGIC, sizeof(header.magic)) == 0
+            && header.version == VERSION && header.sourceSize == sourceSize && header.levelCount > 0 && header.levelCount <= 32
+            && header.width > 0 && header.height > 0
+            && (header.format == GL_COMPRESSED_RED_RGTC1 || header.format == GL_COMPRESSED_RG_RGTC2
+                || header.format == S3TC::COMPRESSED_RGB_DXT1 || header.format == S3TC::COMPRESSED_RGBA_DXT5)
+            && matches(header.format, normalMap) && tables <= size;
+
+        // each level has to be the size of its block grid and lie inside the file
+        image.levels.clear();
+        const LevelRecord* records = (const LevelRecord*)(data + sizeof(Header));
+        uint32_t w = header.width, h = header.height;
+        for (uint32_t i = 0; valid && i < header.levelCount; ++i)
+        {
+            const LevelRecord& record = records[i];
+            valid = record.width == w && record.height == h && record.size == BlockCompression::levelBytes(header.format, w, h)
+                && record.offset % ALIGNMENT == 0 && record.offset >= tables
+                && record.offset <= size && record.size <= size - record.offset;
+            image.levels.push_back({ data + record.offset, record.size, record.width, record.height });
+            w = std::max(w / 2, 1u);
+            h = std::max(h / 2, 1u);
+        }
+        if (!valid)
+        {
+            image.levels.clear();
+            image.file.close();
+            return false;
+        }
+        image.format = header.format;
+        return true;
+    }
+
+    // written to a temporary file and renamed, an interrupted write leaves no cache behind
+    inline bool write(const std::string& sourcePath, const CompressedImage& image)
+    {
+        std::error_code ec;
+        uint64_t sourceSize = std::filesystem::file_size(sourcePath, ec);
+        if (ec || image.levels.empty())
+            return false;
+
+        std::vector<LevelRecord> records(image.levels.size());
+        uint64_t offset = sizeof(Header) + records.size() * sizeof(LevelRecord);
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            records[i] = {};
+            records[i].offset = offset = align(offset);
+            records[i].size = image.levels[i].size;
+            records[i].width = image.levels[i].width;
+            records[i].height = image.levels[i].height;
+            offset += records[i].size;
+        }
+
+        const std::string path = cachePath(sourcePath);
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cout << "ERROR::TEXTURE_CACHE::" << temporary << " cannot be written" << std::endl;
+                return false;
+            }
+
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.sourceSize = sourceSize;
+            header.format = image.format;
+            header.width = image.levels[0].width;
+            header.height = image.levels[0].height;
+            header.levelCount = (uint32_t)records.size();
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)records.data(), records.size() * sizeof(LevelRecord));
+
+            const char padding[ALIGNMENT] = {};
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                out.write(padding, (std::streamsize)(records[i].offset - (uint64_t)out.tellp()));
+                out.write((const char*)image.levels[i].data, image.levels[i].size);
+            }
+            if (!out)
+            {
+                std::cout << "ERROR::TEXTURE_CACHE::" << temporary << " could not be written completely" << std::endl;
+                return false;
+            }
+        }
+
+        std::filesystem::rename(temporary, path, ec);
+        if (ec)
+        {
+            std::cout << "ERROR::TEXTURE_CACHE::" << path << " cannot be replaced: " << ec.message() << std::endl;
+            std::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+
+    // the cached blocks of filename, compressed and cached first if needed
+    // (compressed tells which); false if the image cannot be decoded. Safe to
+    // call from worker threads.
+    inline bool load(const std::string& filename, bool normalMap, CompressedImage& image, bool& compressed)
+    {
+        compressed = false;
+        if (read(filename, normalMap, image))
+            return true;
+        int width, height, components;
+        unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &components, 0);
+        if (!pixels)
+            return false;
+        compress(pixels, width, height, components, normalMap, image);
+        stbi_image_free(pixels);
+        write(filename, image);
+        compressed = true;
+        return true;
+    }
+}
+
+// create the storage, mip chain and sampling state of texture id from compressed blocks
+inline void uploadCompressedImage(unsigned int id, const CompressedImage& image)
+{
+    glBindTexture(GL_TEXTURE_2D, id);
+    for (size_t level = 0; level < image.levels.size(); ++level)
+    {
+        const CompressedImage::Level& l = image.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, image.format, l.width, l.height, 0, l.size, l.data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+#endif
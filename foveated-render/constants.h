@@ -8,6 +8,15 @@ namespace NVShadingRate {
     constexpr unsigned int PALETTE_SIZE = 0x955E;
     constexpr unsigned int NO_INVOCATIONS = 0x9564;
     constexpr unsigned int ONE_INVOCATION_PER_PIXEL = 0x9565;
+    constexpr unsigned int ONE_INVOCATION_PER_1X2 = 0x9566;
+    constexpr unsigned int ONE_INVOCATION_PER_2X1 = 0x9567;
     constexpr unsigned int ONE_INVOCATION_PER_2X2 = 0x9568;
+    constexpr unsigned int ONE_INVOCATION_PER_2X4 = 0x9569;
+    constexpr unsigned int ONE_INVOCATION_PER_4X2 = 0x956A;
     constexpr unsigned int ONE_INVOCATION_PER_4X4 = 0x956B;
 }
+
+namespace S3TC {
+    constexpr unsigned int COMPRESSED_RGB_DXT1 = 0x83F0;
+    constexpr unsigned int COMPRESSED_RGBA_DXT5 = 0x83F3;
+}
@@ -0,0 +1,119 @@
+#ifndef COUNTING_ALLOCATOR_H
+#define COUNTING_ALLOCATOR_H
+
+#include <onnxruntime_cxx_api.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+// CPU allocator for ONNX Runtime that keeps freed blocks for reuse and counts
+// how often it had to go to the heap. Registered with the Env and used by a
+// session through "session.use_env_allocators", it serves every tensor ORT
+// allocates for that session, the intermediates of each Run included, so a
+// steady-state loop that reuses its memory leaves heapAllocations() alone.
+// Memory ORT allocates outside its allocators is not seen.
+class CountingOrtAllocator : public OrtAllocator
+{
+public:
+    CountingOrtAllocator()
+        : OrtAllocator{}, m_info(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault))
+    {
+        version = ORT_API_VERSION;
+        Alloc = &CountingOrtAllocator::allocCallback;
+        Free = &CountingOrtAllocator::freeCallback;
+        Info = &CountingOrtAllocator::infoCallback;
+    }
+
+    // blocks still handed out belong to sessions, which have to go first
+    ~CountingOrtAllocator()
+    {
+        while (m_free)
+        {
+            Block* next = m_free->next;
+            ::operator delete(m_free, std::align_val_t(ALIGNMENT));
+            m_free = next;
+        }
+    }
+
+    CountingOrtAllocator(const CountingOrtAllocator&) = delete;
+    CountingOrtAllocator& operator=(const CountingOrtAllocator&) = delete;
+
+    // blocks that had to come from the heap, a reused block is not counted
+    uint64_t heapAllocations() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_heapAllocations;
+    }
+
+    // every allocation ORT asked for
+    uint64_t requests() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_requests;
+    }
+
+private:
+    // ORT's own CPU allocator aligns to 64 bytes, the header keeps that for the payload
+    static const size_t ALIGNMENT = 64;
+
+    struct Block
+    {
+        size_t size;
+        Block* next;
+    };
+    static_assert(sizeof(Block) <= ALIGNMENT, "block header must fit in the alignment padding");
+
+    Ort::MemoryInfo m_info;
+    mutable std::mutex m_mutex;
+    // freed blocks, only reused for a request of exactly their size, which is
+    // what ORT asks for again on every Run with the same shapes
+    Block* m_free = nullptr;
+    uint64_t m_heapAllocations = 0;
+    uint64_t m_requests = 0;
+
+    void* allocate(size_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_requests;
+        for (Block** link = &m_free; *link; link = &(*link)->next)
+        {
+            if ((*link)->size == size)
+            {
+                Block* block = *link;
+                *link = block->next;
+                return (uint8_t*)block + ALIGNMENT;
+            }
+        }
+        ++m_heapAllocations;
+        Block* block = (Block*)::operator new(ALIGNMENT + size, std::align_val_t(ALIGNMENT));
+        block->size = size;
+        return (uint8_t*)block + ALIGNMENT;
+    }
+
+    void release(void* p)
+    {
+        if (!p)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Block* block = (Block*)((uint8_t*)p - ALIGNMENT);
+        block->next = m_free;
+        m_free = block;
+    }
+
+    static void* ORT_API_CALL allocCallback(OrtAllocator* self, size_t size)
+    {
+        return static_cast<CountingOrtAllocator*>(self)->allocate(size);
+    }
+    static void ORT_API_CALL freeCallback(OrtAllocator* self, void* p)
+    {
+        static_cast<CountingOrtAllocator*>(self)->release(p);
+    }
+    static const OrtMemoryInfo* ORT_API_CALL infoCallback(const OrtAllocator* self)
+    {
+        return static_cast<const CountingOrtAllocator*>(self)->m_info;
+    }
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef FOVEATION_FIELD_H
+#define FOVEATION_FIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Physical size of one shading rate texel and the viewing distance, used to
+// turn texel offsets into degrees of visual angle.
+struct FoveationGeometry
+{
+    float texelWidthMM;
+    float texelHeightMM;
+    float viewingDistanceMM;
+    // vertical radius relative to the horizontal one, < 1 gives a horizontally
+    // elongated fovea, 1 a circular one
+    float verticalScale = 1.0f;
+};
+
+// Precomputed squared eccentricity, in degrees of visual angle, from a gaze
+// center to every texel of the shading rate image. The table covers twice the
+// image size in each direction, indexed by the signed texel offset, so for any
+// gaze position snapped to a texel corner the map is a window into the same
+// table: row y of the map reads row (y - centerY + height) starting at column
+// (width - centerX).
+//
+// Offsets are measured in millimetres on the panel, so the regions stay round
+// on non-square screens. Vertical offsets are divided by verticalScale, which
+// turns every ring into an ellipse whose horizontal radius is the threshold.
+//
+// Only the center moves from frame to frame, so classifying a texel reduces to
+// a table lookup and a threshold compare, whatever the falloff math.
+class FoveationField
+{
+public:
+    // rebuild the table for a shading rate image of width x height texels
+    void build(int width, int height, const FoveationGeometry& geometry)
+    {
+        m_width = width;
+        m_height = height;
+        m_stride = 2 * width;
+        m_geometry = geometry;
+        m_distanceSq.resize((size_t)m_stride * 2 * height);
+
+        const double radToDeg = 180.0 / 3.14159265358979323846;
+        const double verticalScale = geometry.verticalScale > 0.0f ? geometry.verticalScale : 1.0f;
+        for (int row = 0; row < 2 * height; ++row)
+        {
+            double dy = (row - height) * (double)geometry.texelHeightMM / verticalScale;
+            float* out = m_distanceSq.data() + (size_t)row * m_stride;
+            for (int col = 0; col < m_stride; ++col)
+            {
+                double dx = (col - width) * (double)geometry.texelWidthMM;
+                double eccentricity = std::atan(std::sqrt(dx * dx + dy * dy) / geometry.viewingDistanceMM) * radToDeg;
+                out[col] = (float)(eccentricity * eccentricity);
+            }
+        }
+        ++m_generation;
+    }
+    // true if the table was built for this image size and geometry
+    bool matches(int width, int height, const FoveationGeometry& geometry) const
+    {
+        return m_width == width && m_height == height
+            && m_geometry.texelWidthMM == geometry.texelWidthMM
+            && m_geometry.texelHeightMM == geometry.texelHeightMM
+            && m_geometry.viewingDistanceMM == geometry.viewingDistanceMM
+            && m_geometry.verticalScale == geometry.verticalScale;
+    }
+
+    // gaze point in normalized [0,1] coordinates snapped to the nearest texel corner
+    void centerTexel(float x, float y, int& texelX, int& texelY) const
+    {
+        texelX = std::clamp((int)std::lround(x * m_width), 0, m_width);
+        texelY = std::clamp((int)std::lround(y * m_height), 0, m_height);
+    }
+
+    // squared eccentricities for map row y, valid for texels [0, width)
+    const float* row(int y, int centerTexelX, int centerTexelY) const
+    {
+        return m_distanceSq.data() + (size_t)(y - centerTexelY + m_height) * m_stride + (m_width - centerTexelX);
+    }
+
+    const float* data() const { return m_distanceSq.data(); }
+    size_t size() const { return m_distanceSq.size(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int stride() const { return m_stride; }
+    // bumped on every rebuild, lets GPU copies of the table know they are stale
+    uint32_t generation() const { return m_generation; }
+
+private:
+    std::vector<float> m_distanceSq;
+    int m_width = 0;
+    int m_height = 0;
+    int m_stride = 0;
+    FoveationGeometry m_geometry = {};
+    uint32_t m_generation = 0;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef FOVEATION_KERNEL_H
+#define FOVEATION_KERNEL_H
+
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define FOVEATION_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define FOVEATION_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(FOVEATION_KERNEL_X86) && !defined(_MSC_VER)
+#define FOVEATION_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FOVEATION_TARGET_AVX2
+#endif
+
+// Classifies one row of the shading rate image from a row of precomputed
+// squared distances (see FoveationField). A texel's rate is baseRate + the
+// number of squared-distance thresholds its distance reaches, so thresholdsSq
+// must be ascending. Texels are written in place and [changedFirst, changedLast]
+// is grown to cover every texel whose value differs from what was there before
+// (left untouched if none did).
+//
+// All paths only compare, so every one of them produces the same map as
+// classifyRowScalar.
+namespace FoveationKernel
+{
+    struct RowParams
+    {
+        int width;
+        const float* distanceSq;    // width squared distances to the gaze center
+        const float* thresholdsSq;
+        int thresholdCount;
+        uint8_t baseRate;
+    };
+
+    typedef void (*RowFunc)(uint8_t* row, const RowParams& p, int& changedFirst, int& changedLast);
+
+    inline void classifyRange(uint8_t* row, const RowParams& p, int begin, int& changedFirst, int& changedLast)
+    {
+        for (int x = begin; x < p.width; ++x)
+        {
+            float d2 = p.distanceSq[x];
+
+            uint8_t rate = p.baseRate;
+            for (int t = 0; t < p.thresholdCount; ++t)
+                rate += d2 >= p.thresholdsSq[t];
+
+            if (row[x] != rate)
+            {
+                row[x] = rate;
+                if (x < changedFirst) changedFirst = x;
+                if (x > changedLast) changedLast = x;
+            }
+        }
+    }
+
+    // reference implementation the vector paths are verified against
+    inline void classifyRowScalar(uint8_t* row, const RowParams& p, int& changedFirst, int& changedLast)
+    {
+        classifyRange(row, p, 0, changedFirst, changedLast);
+    }
+
+    inline void markChangedBits(uint32_t mask, int x, int& changedFirst, int& changedLast)
+    {
+        if (!mask)
+            return;
+#ifdef _MSC_VER
+        unsigned long low, high;
+        _BitScanForward(&low, mask);
+        _BitScanReverse(&high, mask);
+#else
+        int low = __builtin_ctz(mask);
+        int high = 31 - __builtin_clz(mask);
+#endif
+        if (x + (int)low < changedFirst) changedFirst = x + (int)low;
+        if (x + (int)high > changedLast) changedLast = x + (int)high;
+    }
+
+#if defined(FOVEATION_KERNEL_X86)
+    // 16 texels per iteration
+    inline void classifyRowSSE2(uint8_t* row, const RowParams& p, int& changedFirst, int& changedLast)
+    {
+        const __m128i base = _mm_set1_epi8((char)p.baseRate);
+
+        int x = 0;
+        for (; x + 16 <= p.width; x += 16)
+        {
+            __m128i counts[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128 d2 = _mm_loadu_ps(p.distanceSq + x + 4 * i);
+                __m128i count = _mm_setzero_si128();
+                for (int t = 0; t < p.thresholdCount; ++t)
+                    count = _mm_sub_epi32(count, _mm_castps_si128(_mm_cmpge_ps(d2, _mm_set1_ps(p.thresholdsSq[t]))));
+                counts[i] = count;
+            }
+            __m128i packed = _mm_packs_epi16(_mm_packs_epi32(counts[0], counts[1]), _mm_packs_epi32(counts[2], counts[3]));
+            __m128i rates = _mm_add_epi8(packed, base);
+
+            __m128i old = _mm_loadu_si128((const __m128i*)(row + x));
+            uint32_t changed = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(old, rates)) & 0xFFFFu;
+            markChangedBits(changed, x, changedFirst, changedLast);
+            _mm_storeu_si128((__m128i*)(row + x), rates);
+        }
+        classifyRange(row, p, x, changedFirst, changedLast);
+    }
+
+    // 32 texels per iteration
+    FOVEATION_TARGET_AVX2
+    inline void classifyRowAVX2(uint8_t* row, const RowParams& p, int& changedFirst, int& changedLast)
+    {
+        const __m256i base = _mm256_set1_epi8((char)p.baseRate);
+        // packs work per 128-bit lane, this restores texel order afterwards
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        int x = 0;
+        for (; x + 32 <= p.width; x += 32)
+        {
+            __m256i counts[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                __m256 d2 = _mm256_loadu_ps(p.distanceSq + x + 8 * i);
+                __m256i count = _mm256_setzero_si256();
+                for (int t = 0; t < p.thresholdCount; ++t)
+                    count = _mm256_sub_epi32(count, _mm256_castps_si256(_mm256_cmp_ps(d2, _mm256_set1_ps(p.thresholdsSq[t]), _CMP_GE_OQ)));
+                counts[i] = count;
+            }
+            __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(counts[0], counts[1]), _mm256_packs_epi32(counts[2], counts[3]));
+            __m256i rates = _mm256_add_epi8(_mm256_permutevar8x32_epi32(packed, order), base);
+
+            __m256i old = _mm256_loadu_si256((const __m256i*)(row + x));
+            uint32_t changed = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(old, rates));
+            markChangedBits(changed, x, changedFirst, changedLast);
+            _mm256_storeu_si256((__m256i*)(row + x), rates);
+        }
+        classifyRange(row, p, x, changedFirst, changedLast);
+    }
+
+    inline bool cpuHasAVX2()
+    {
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] < 7)
+            return false;
+        __cpuid(regs, 1);
+        bool osxsave = (regs[2] & (1 << 27)) != 0;
+        bool avx = (regs[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+        __cpuidex(regs, 7, 0);
+        return (regs[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+#if defined(FOVEATION_KERNEL_NEON)
+    // 16 texels per iteration
+    inline void classifyRowNEON(uint8_t* row, const RowParams& p, int& changedFirst, int& changedLast)
+    {
+        const uint8x16_t base = vdupq_n_u8(p.baseRate);
+
+        int x = 0;
+        for (; x + 16 <= p.width; x += 16)
+        {
+            uint32x4_t counts[4];
+            for (int i = 0; i < 4; ++i)
+            {
+                float32x4_t d2 = vld1q_f32(p.distanceSq + x + 4 * i);
+                uint32x4_t count = vdupq_n_u32(0);
+                for (int t = 0; t < p.thresholdCount; ++t)
+                    count = vsubq_u32(count, vcgeq_f32(d2, vdupq_n_f32(p.thresholdsSq[t])));
+                counts[i] = count;
+            }
+            uint16x8_t lo = vcombine_u16(vmovn_u32(counts[0]), vmovn_u32(counts[1]));
+            uint16x8_t hi = vcombine_u16(vmovn_u32(counts[2]), vmovn_u32(counts[3]));
+            uint8x16_t rates = vaddq_u8(vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)), base);
+
+            uint8x16_t old = vld1q_u8(row + x);
+            uint8_t same[16];
+            vst1q_u8(same, vceqq_u8(old, rates));
+            uint32_t changed = 0;
+            for (int i = 0; i < 16; ++i)
+                changed |= (uint32_t)(same[i] == 0) << i;
+            markChangedBits(changed, x, changedFirst, changedLast);
+            vst1q_u8(row + x, rates);
+        }
+        classifyRange(row, p, x, changedFirst, changedLast);
+    }
+#endif
+
+    inline RowFunc selectRowFunc(const char** name = nullptr)
+    {
+        const char* isa = "scalar";
+        RowFunc func = classifyRowScalar;
+#if defined(FOVEATION_KERNEL_X86)
+        if (cpuHasAVX2())
+        {
+            isa = "AVX2";
+            func = classifyRowAVX2;
+        }
+        else
+        {
+            isa = "SSE2";
+            func = classifyRowSSE2;
+        }
+#elif defined(FOVEATION_KERNEL_NEON)
+        isa = "NEON";
+        func = classifyRowNEON;
+#endif
+        if (name)
+            *name = isa;
+        return func;
+    }
+
+    // the widest row kernel supported by this CPU, resolved once
+    inline RowFunc rowFunc()
+    {
+        static const RowFunc func = selectRowFunc();
+        return func;
+    }
+
+    inline const char* rowFuncName()
+    {
+        const char* name;
+        selectRowFunc(&name);
+        return name;
+    }
+
+    struct Path
+    {
+        const char* name;
+        RowFunc func;
+    };
+
+    // every row kernel this CPU can run, the scalar reference first
+    inline std::vector<Path> paths()
+    {
+        std::vector<Path> all = { { "scalar", classifyRowScalar } };
+#if defined(FOVEATION_KERNEL_X86)
+        all.push_back({ "SSE2", classifyRowSSE2 });
+        if (cpuHasAVX2())
+            all.push_back({ "AVX2", classifyRowAVX2 });
+#elif defined(FOVEATION_KERNEL_NEON)
+        all.push_back({ "NEON", classifyRowNEON });
+#endif
+        return all;
+    }
+
+    // compare a kernel (the dispatched one by default) against the scalar reference
+    // on a sweep of widths, centers and thresholds, true if every map is bit-identical
+    inline bool verify(RowFunc func = rowFunc())
+    {
+        const float thresholdsSq[3] = { 0.01f, 0.04f, 0.09f };
+        const int widths[] = { 1, 15, 16, 17, 31, 32, 33, 120, 240, 480 };
+
+        for (int width : widths)
+        {
+            std::vector<uint8_t> expected(width), actual(width);
+            std::vector<float> distanceSq(width);
+            for (int c = 0; c <= 8; ++c)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    float dx = (float)x / width - c / 8.0f;
+                    distanceSq[x] = dx * dx + (c % 3) * 0.015f;
+                }
+                for (int count = 0; count <= 3; ++count)
+                {
+                    // both start from the previous map, so the changed range is exercised as well
+                    RowParams p = { width, distanceSq.data(), thresholdsSq, count, 1 };
+                    int expectedFirst = width, expectedLast = -1;
+                    int actualFirst = width, actualLast = -1;
+                    classifyRowScalar(expected.data(), p, expectedFirst, expectedLast);
+                    func(actual.data(), p, actualFirst, actualLast);
+                    if (expected != actual || expectedFirst != actualFirst || expectedLast != actualLast)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef FOVEATION_POLICY_H
+#define FOVEATION_POLICY_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "foveation_profile.h"
+
+// Turns the per-frame gaze error into ring radii for a FoveationProfile.
+//
+// The running error jumps up with the measured error and decays back with the
+// profile's error_decay time constant, so a single accurate frame does not
+// immediately shrink the rings. Each ring's target radius is its start
+// eccentricity plus min(growthGain * runningError, maxGrowthDeg). A ring grows
+// to its target at once but only shrinks when the target is more than
+// hysteresisDeg inside it, which keeps the rings from pulsing frame to frame.
+//
+// A prediction older than the profile's stale_after adds stale_gain degrees of
+// error per second beyond that, since the gaze may have moved on since.
+class FoveationPolicy
+{
+public:
+    void reset(const FoveationProfile& profile)
+    {
+        m_profile = &profile;
+        m_runningError = 0.0f;
+        m_radii.assign(profile.thresholdCount(), 0.0f);
+        for (int i = 0; i < profile.thresholdCount(); ++i)
+            m_radii[i] = profile.levels[i + 1].startDeg;
+    }
+
+    // feed the gaze error bound of this frame in degrees and the age of the prediction it is based on
+    void update(float errorDeg, float predictionAgeSeconds, float dtSeconds)
+    {
+        if (!m_profile)
+            return;
+
+        float staleSeconds = predictionAgeSeconds - m_profile->staleAfterSeconds;
+        if (staleSeconds > 0.0f)
+            errorDeg += staleSeconds * m_profile->staleGainDegPerSecond;
+
+        if (errorDeg >= m_runningError || m_profile->errorDecaySeconds <= 0.0f)
+            m_runningError = errorDeg;
+        else
+            m_runningError += (errorDeg - m_runningError) * (1.0f - std::exp(-dtSeconds / m_profile->errorDecaySeconds));
+
+        float previous = 0.0f;
+        for (size_t i = 0; i < m_radii.size(); ++i)
+        {
+            const FoveationLevel& level = m_profile->levels[i + 1];
+            float growth = std::min(level.growthGain * m_runningError, level.maxGrowthDeg);
+            float target = level.startDeg + std::max(growth, 0.0f);
+
+            if (target > m_radii[i] || target < m_radii[i] - m_profile->hysteresisDeg)
+                m_radii[i] = target;
+
+            // rings never end up inside the one before them
+            m_radii[i] = std::max(m_radii[i], previous);
+            previous = m_radii[i];
+        }
+    }
+
+    int ringCount() const { return (int)m_radii.size(); }
+    float radius(int ring) const { return m_radii[ring]; }
+    float runningError() const { return m_runningError; }
+
+private:
+    const FoveationProfile* m_profile = nullptr;
+    std::vector<float> m_radii;
+    float m_runningError = 0.0f;
+};
+
+#endif
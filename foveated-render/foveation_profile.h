@@ -0,0 +1,192 @@
+#ifndef FOVEATION_PROFILE_H
+#define FOVEATION_PROFILE_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+// matches MAX_THRESHOLDS in foveation.comp
+const int MAX_FOVEATION_THRESHOLDS = 8;
+
+// One step of a foveation profile: from startDeg of eccentricity outwards
+// (up to the next level) texels are shaded at rate. The start of the level
+// moves out by min(growthGain * error, maxGrowthDeg) when the gaze error grows.
+struct FoveationLevel
+{
+    float startDeg;
+    unsigned int rate;
+    float growthGain = 1.0f;
+    float maxGrowthDeg = 10.0f;
+};
+
+// An ordered list of eccentricity thresholds and the NV shading rate used
+// beyond each of them. Level i is stored at palette index i + 1 (index 0 stays
+// NO_INVOCATIONS), so the shading rate image value of a texel is 1 plus the
+// number of level thresholds its eccentricity reaches.
+//
+// Profiles are plain text, one level per line, '#' starts a comment:
+//
+//     # start_deg  rate  [growth_gain  max_growth_deg]
+//     0            1x1
+//     6.5          2x2   1.0          8
+//     14.25        4x4   0.5          4
+//     hysteresis   0.25
+//     error_decay  0.5
+//     stale_after  0.05
+//     stale_gain   50
+//     vertical_scale 1
+//
+// Rates are 1x1, 1x2, 2x1, 2x2, 2x4, 4x2 and 4x4 (width x height in pixels).
+// hysteresis, error_decay, stale_after and stale_gain tune the FoveationPolicy
+// that drives the growth; vertical_scale shapes the levels themselves.
+class FoveationProfile
+{
+public:
+    std::vector<FoveationLevel> levels;
+    // rings only shrink once their target is this many degrees inside them
+    float hysteresisDeg = 0.25f;
+    // time constant of the running gaze error once the error drops
+    float errorDecaySeconds = 0.5f;
+    // predictions older than this count as stale and add staleGainDegPerSecond
+    // of gaze error per second of extra age
+    float staleAfterSeconds = 0.05f;
+    float staleGainDegPerSecond = 50.0f;
+    // vertical radius of every level relative to its horizontal one, 1 keeps them circular
+    float verticalScale = 1.0f;
+
+    // three rings matching the original hard-coded behaviour
+    static FoveationProfile defaults(float innerDeg, float middleDeg)
+    {
+        FoveationProfile profile;
+        profile.levels = {
+            { 0.0f, NVShadingRate::ONE_INVOCATION_PER_PIXEL },
+            { innerDeg, NVShadingRate::ONE_INVOCATION_PER_2X2 },
+            { middleDeg, NVShadingRate::ONE_INVOCATION_PER_4X4 } };
+        return profile;
+    }
+
+    // replace the levels with the ones in path, keeps the current levels and returns false on error
+    bool loadFromFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            std::cout << "Foveation profile " << path << " not found, using defaults" << std::endl;
+            return false;
+        }
+
+        std::vector<FoveationLevel> parsed;
+        float hysteresis = hysteresisDeg;
+        float errorDecay = errorDecaySeconds;
+        float staleAfter = staleAfterSeconds;
+        float staleGain = staleGainDegPerSecond;
+        float vertical = verticalScale;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key))
+                continue;
+
+            float* setting = key == "hysteresis" ? &hysteresis
+                : key == "error_decay" ? &errorDecay
+                : key == "stale_after" ? &staleAfter
+                : key == "stale_gain" ? &staleGain
+                : key == "vertical_scale" ? &vertical
+                : nullptr;
+            if (setting)
+            {
+                float value;
+                // a zero vertical scale would collapse every level to a line
+                if (!(fields >> value) || value < 0.0f || (setting == &vertical && value == 0.0f))
+                {
+                    std::cout << "ERROR::FOVEATION_PROFILE::" << path << ":" << lineNumber << " invalid value for " << key << std::endl;
+                    return false;
+                }
+                *setting = value;
+                continue;
+            }
+
+            FoveationLevel level;
+            std::istringstream start(key);
+            if (!(start >> level.startDeg))
+            {
+                std::cout << "ERROR::FOVEATION_PROFILE::" << path << ":" << lineNumber << " unknown setting '" << key << "'" << std::endl;
+                return false;
+            }
+
+            std::string rateName;
+            if (!(fields >> rateName) || !parseRate(rateName, level.rate))
+            {
+                std::cout << "ERROR::FOVEATION_PROFILE::" << path << ":" << lineNumber << " invalid rate '" << rateName << "'" << std::endl;
+                return false;
+            }
+            if (fields >> level.growthGain)
+                fields >> level.maxGrowthDeg;
+
+            if (!parsed.empty() && level.startDeg <= parsed.back().startDeg)
+            {
+                std::cout << "ERROR::FOVEATION_PROFILE::" << path << ":" << lineNumber << " eccentricities must increase" << std::endl;
+                return false;
+            }
+            parsed.push_back(level);
+        }
+
+        if (parsed.empty() || parsed.front().startDeg != 0.0f)
+        {
+            std::cout << "ERROR::FOVEATION_PROFILE::" << path << " first level must start at 0 degrees" << std::endl;
+            return false;
+        }
+        if ((int)parsed.size() > MAX_FOVEATION_THRESHOLDS + 1)
+        {
+            std::cout << "ERROR::FOVEATION_PROFILE::" << path << " at most " << MAX_FOVEATION_THRESHOLDS + 1 << " levels are supported" << std::endl;
+            return false;
+        }
+
+        levels = parsed;
+        hysteresisDeg = hysteresis;
+        errorDecaySeconds = errorDecay;
+        staleAfterSeconds = staleAfter;
+        staleGainDegPerSecond = staleGain;
+        verticalScale = vertical;
+        return true;
+    }
+
+    // eccentricity thresholds between levels, levels.size() - 1 of them
+    int thresholdCount() const
+    {
+        return (int)levels.size() - 1;
+    }
+
+    static bool parseRate(const std::string& name, unsigned int& rate)
+    {
+        static const struct { const char* name; unsigned int rate; } rates[] = {
+            { "1x1", NVShadingRate::ONE_INVOCATION_PER_PIXEL },
+            { "1x2", NVShadingRate::ONE_INVOCATION_PER_1X2 },
+            { "2x1", NVShadingRate::ONE_INVOCATION_PER_2X1 },
+            { "2x2", NVShadingRate::ONE_INVOCATION_PER_2X2 },
+            { "2x4", NVShadingRate::ONE_INVOCATION_PER_2X4 },
+            { "4x2", NVShadingRate::ONE_INVOCATION_PER_4X2 },
+            { "4x4", NVShadingRate::ONE_INVOCATION_PER_4X4 } };
+
+        for (const auto& entry : rates)
+        {
+            if (name == entry.name)
+            {
+                rate = entry.rate;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef GAZE_FILTER_H
+#define GAZE_FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "gaze_sample.h"
+
+struct GazeFilterParams
+{
+    // degrees per tracker unit, the filters work in degrees so their
+    // parameters do not depend on the screen
+    float degreesPerUnitX = 1.0f;
+    float degreesPerUnitY = 1.0f;
+    // largest lag the filter may add at rest; tightens minCutoffHz and
+    // accelerationNoiseDeg to fit, 0 leaves them as set
+    float latencyBudgetMs = 8.0f;
+    // gaps longer than this (blinks, lost tracking) restart the filter
+    float resetGapMs = 100.0f;
+
+    // One-Euro: cutoff = minCutoff + beta * speed
+    float minCutoffHz = 1.0f;
+    float beta = 0.3f;
+    float derivativeCutoffHz = 1.0f;
+
+    // constant-velocity Kalman
+    float measurementNoiseDeg = 0.3f;
+    float accelerationNoiseDeg = 2000.0f;
+};
+
+// Smooths the gaze stream between the tracker and its consumers. Filters see
+// every valid sample in order and replace its position; invalid samples pass
+// through and restart the filter. lagMs() and noiseGain() describe the current
+// operating point: the time constant the filter adds and the factor by which
+// it scales the tracker noise at rest.
+class GazeFilter
+{
+public:
+    explicit GazeFilter(const GazeFilterParams& params) : m_params(params) {}
+    virtual ~GazeFilter() {}
+
+    void filter(GazeSample& sample)
+    {
+        if (!sample.valid)
+        {
+            m_started = false;
+            return;
+        }
+        float dt = (sample.timestampUs - m_lastUs) * 1e-6f;
+        if (!m_started || dt * 1000.0f > m_params.resetGapMs)
+        {
+            reset(sample.x * m_params.degreesPerUnitX, sample.y * m_params.degreesPerUnitY);
+            m_started = true;
+            m_lastUs = sample.timestampUs;
+            return;
+        }
+        // repeated timestamps carry no new information about the motion
+        if (dt <= 0.0f)
+            return;
+
+        float xDeg = sample.x * m_params.degreesPerUnitX;
+        float yDeg = sample.y * m_params.degreesPerUnitY;
+        update(xDeg, yDeg, dt);
+        sample.x = xDeg / m_params.degreesPerUnitX;
+        sample.y = yDeg / m_params.degreesPerUnitY;
+        m_lastUs = sample.timestampUs;
+    }
+
+    virtual float lagMs() const = 0;
+    virtual float noiseGain() const = 0;
+    virtual const char* name() const = 0;
+
+protected:
+    GazeFilterParams m_params;
+
+    virtual void reset(float xDeg, float yDeg) = 0;
+    // filter the position in place, dt in seconds since the previous sample
+    virtual void update(float& xDeg, float& yDeg, float dt) = 0;
+
+private:
+    bool m_started = false;
+    int64_t m_lastUs = 0;
+};
+
+// One-Euro filter (Casiez et al. 2012): a low-pass filter whose cutoff rises
+// with the gaze speed, heavy smoothing during fixations and little lag during
+// saccades. Speed is taken over both axes so they switch together.
+class OneEuroGazeFilter : public GazeFilter
+{
+public:
+    explicit OneEuroGazeFilter(const GazeFilterParams& params) : GazeFilter(params)
+    {
+        // at rest the filter lags by 1 / (2 pi minCutoff)
+        if (m_params.latencyBudgetMs > 0.0f)
+            m_params.minCutoffHz = std::max(m_params.minCutoffHz, 1000.0f / (TWO_PI * m_params.latencyBudgetMs));
+        m_cutoff = m_params.minCutoffHz;
+    }
+
+    float lagMs() const override { return 1000.0f / (TWO_PI * m_cutoff); }
+    float noiseGain() const override { return std::sqrt(m_alpha / (2.0f - m_alpha)); }
+    const char* name() const override { return "one-euro"; }
+
+protected:
+    void reset(float xDeg, float yDeg) override
+    {
+        m_x = xDeg;
+        m_y = yDeg;
+        m_dx = m_dy = 0.0f;
+        m_cutoff = m_params.minCutoffHz;
+    }
+
+    void update(float& xDeg, float& yDeg, float dt) override
+    {
+        float derivativeAlpha = alpha(m_params.derivativeCutoffHz, dt);
+        m_dx += ((xDeg - m_x) / dt - m_dx) * derivativeAlpha;
+        m_dy += ((yDeg - m_y) / dt - m_dy) * derivativeAlpha;
+
+        m_cutoff = m_params.minCutoffHz + m_params.beta * std::sqrt(m_dx * m_dx + m_dy * m_dy);
+        m_alpha = alpha(m_cutoff, dt);
+        m_x += (xDeg - m_x) * m_alpha;
+        m_y += (yDeg - m_y) * m_alpha;
+        xDeg = m_x;
+        yDeg = m_y;
+    }
+
+private:
+    static constexpr float TWO_PI = 6.2831853f;
+
+    float m_x = 0.0f, m_y = 0.0f;
+    float m_dx = 0.0f, m_dy = 0.0f;
+    float m_cutoff = 1.0f;
+    float m_alpha = 1.0f;
+
+    static float alpha(float cutoffHz, float dt)
+    {
+        float r = TWO_PI * cutoffHz * dt;
+        return r / (r + 1.0f);
+    }
+};
+
+// Constant-velocity Kalman filter per axis, state (position, velocity) driven by
+// white acceleration noise. Unlike a low-pass filter it has no lag on constant
+// motion; the lag reported is the time constant of its response to a jump.
+class KalmanGazeFilter : public GazeFilter
+{
+public:
+    explicit KalmanGazeFilter(const GazeFilterParams& params) : GazeFilter(params) {}
+
+    float lagMs() const override
+    {
+        float gain = m_axes[0].gain[0];
+        return gain > 0.0f ? 1000.0f * m_dt * (1.0f - gain) / gain : 0.0f;
+    }
+    // steady-state alpha-beta noise reduction for the current gains
+    float noiseGain() const override
+    {
+        float a = m_axes[0].gain[0];
+        float b = m_axes[0].gain[1] * m_dt;
+        float denominator = a * (4.0f - 2.0f * a - b);
+        return denominator > 0.0f ? std::sqrt(std::max(0.0f, (2.0f * a * a + 2.0f * b - 3.0f * a * b) / denominator)) : 1.0f;
+    }
+    const char* name() const override { return "kalman"; }
+
+protected:
+    void reset(float xDeg, float yDeg) override
+    {
+        float r = m_params.measurementNoiseDeg * m_params.measurementNoiseDeg;
+        m_axes[0] = Axis{ { xDeg, 0.0f }, { r, 0.0f, 0.0f, VELOCITY_VARIANCE }, { 1.0f, 0.0f } };
+        m_axes[1] = Axis{ { yDeg, 0.0f }, { r, 0.0f, 0.0f, VELOCITY_VARIANCE }, { 1.0f, 0.0f } };
+    }
+
+    void update(float& xDeg, float& yDeg, float dt) override
+    {
+        if (!m_tuned)
+        {
+            tune(dt);
+            m_tuned = true;
+        }
+        m_dt = dt;
+        xDeg = m_axes[0].update(xDeg, dt, m_accelerationNoise, m_params.measurementNoiseDeg);
+        yDeg = m_axes[1].update(yDeg, dt, m_accelerationNoise, m_params.measurementNoiseDeg);
+    }
+
+private:
+    // initial velocity uncertainty, (100 deg/s)^2
+    static constexpr float VELOCITY_VARIANCE = 1e4f;
+
+    struct Axis
+    {
+        float state[2];
+        // covariance, row major
+        float p[4];
+        float gain[2];
+
+        float update(float measurement, float dt, float accelerationNoise, float measurementNoise)
+        {
+            // predict, F = [1 dt; 0 1], Q = q [dt^4/4 dt^3/2; dt^3/2 dt^2]
+            float q = accelerationNoise * accelerationNoise;
+            float dt2 = dt * dt;
+            state[0] += state[1] * dt;
+            float p00 = p[0] + dt * (p[1] + p[2]) + dt2 * p[3] + q * dt2 * dt2 * 0.25f;
+            float p01 = p[1] + dt * p[3] + q * dt2 * dt * 0.5f;
+            float p11 = p[3] + q * dt2;
+
+            // correct with the position measurement
+            float s = p00 + measurementNoise * measurementNoise;
+            gain[0] = p00 / s;
+            gain[1] = p01 / s;
+            float residual = measurement - state[0];
+            state[0] += gain[0] * residual;
+            state[1] += gain[1] * residual;
+            p[0] = (1.0f - gain[0]) * p00;
+            p[1] = p[2] = (1.0f - gain[0]) * p01;
+            p[3] = p11 - gain[1] * p01;
+            return state[0];
+        }
+    };
+
+    Axis m_axes[2] = {};
+    float m_accelerationNoise = 0.0f;
+    float m_dt = 0.0f;
+    bool m_tuned = false;
+
+    // Raise the acceleration noise until the steady-state filter at the first
+    // sample interval responds within the latency budget. The steady state of
+    // this filter is the alpha-beta filter with Kalata's tracking index
+    // lambda = accelerationNoise * dt^2 / measurementNoise.
+    void tune(float dt)
+    {
+        m_accelerationNoise = m_params.accelerationNoiseDeg;
+        if (m_params.latencyBudgetMs <= 0.0f || m_params.measurementNoiseDeg <= 0.0f)
+            return;
+
+        // time constant dt * (1 - alpha) / alpha within the budget
+        float budget = m_params.latencyBudgetMs * 1e-3f;
+        float requiredAlpha = dt / (budget + dt);
+        float low = 0.0f, high = 1e4f;
+        for (int i = 0; i < 60; ++i)
+        {
+            float lambda = 0.5f * (low + high);
+            if (kalataAlpha(lambda) < requiredAlpha)
+                low = lambda;
+            else
+                high = lambda;
+        }
+        m_accelerationNoise = std::max(m_accelerationNoise, high * m_params.measurementNoiseDeg / (dt * dt));
+    }
+
+    static float kalataAlpha(float lambda)
+    {
+        // in double, the terms cancel for large lambda
+        double l = lambda;
+        double root = std::sqrt(l * l + 8.0 * l);
+        return (float)((-l * l - 8.0 * l + (l + 4.0) * root) / 8.0);
+    }
+};
+
+#endif
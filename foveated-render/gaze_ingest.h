@@ -0,0 +1,176 @@
+#ifndef GAZE_INGEST_H
+#define GAZE_INGEST_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gaze_filter.h"
+#include "gaze_sample.h"
+#include "gaze_source.h"
+#include "gaze_trace.h"
+#include "spsc_ring.h"
+
+// Polls a GazeSource on its own thread and hands every gaze sample to each
+// consumer thread through its own lock-free ring.
+//
+// Sources deliver everything that arrived since their previous poll, so
+// polling faster than the frame rate keeps each tracker sample with its own
+// timestamp instead of aliasing the tracker rate to the frame rate. Consumers
+// only drain their ring; the source is only ever touched by the ingest thread
+// while it is running. A sample is handed to all consumers or to none of them,
+// and when recording, exactly the handed-out samples go to the trace.
+//
+// An optional GazeFilter runs on the ingest thread right before the fan-out,
+// so every consumer sees the same smoothed stream. The trace keeps the raw
+// samples, a replay can be filtered differently.
+class GazeIngest : private GazeSink
+{
+public:
+    // ~3.4 s of samples at 1200 Hz, plenty for a stalled frame
+    static const size_t RING_CAPACITY = 4096;
+
+    // every consumer gets its own single-consumer ring
+    enum Consumer
+    {
+        RENDER_CONSUMER,
+        PREDICTOR_CONSUMER,
+        CONSUMER_COUNT
+    };
+
+    GazeIngest() {}
+    ~GazeIngest() { stop(); }
+
+    GazeIngest(const GazeIngest&) = delete;
+    GazeIngest& operator=(const GazeIngest&) = delete;
+
+    // also write every ingested sample to a trace file, call before start()
+    bool record(const std::string& path)
+    {
+        return m_recorder.open(path);
+    }
+
+    // smooth samples before they reach the consumers, call before start()
+    void filter(std::unique_ptr<GazeFilter> filter)
+    {
+        m_filter = std::move(filter);
+    }
+
+    void start(std::unique_ptr<GazeSource> source, std::chrono::microseconds pollInterval = std::chrono::microseconds(500))
+    {
+        joinThread();
+        m_source = std::move(source);
+        m_pollInterval = pollInterval;
+        m_stop = false;
+        m_finished = false;
+        m_thread = std::thread(&GazeIngest::ingestLoop, this);
+    }
+    // stop polling and close the recording, if any
+    void stop()
+    {
+        joinThread();
+        m_recorder.close();
+    }
+
+    // consumer side, false once that consumer's ring is empty
+    bool pop(Consumer consumer, GazeSample& sample)
+    {
+        return m_rings[consumer].pop(sample);
+    }
+
+    // true once the source ran out of samples, they may still be waiting in the rings
+    bool finished() const { return m_finished.load(std::memory_order_acquire); }
+    const char* sourceName() const { return m_source ? m_source->name() : "none"; }
+
+    // samples refused because a consumer's ring was full; live sources lose
+    // them, trace replay offers them again later
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t received() const { return m_received.load(std::memory_order_relaxed); }
+
+    // lag the filter currently adds and its noise scale at that operating point,
+    // 0 and 1 without a filter; cost is the average filter time per sample
+    const char* filterName() const { return m_filter ? m_filter->name() : "none"; }
+    float filterLagMs() const { return m_filterLagMs.load(std::memory_order_relaxed); }
+    float filterNoiseGain() const { return m_filterNoiseGain.load(std::memory_order_relaxed); }
+    float filterCostUs() const
+    {
+        uint64_t samples = m_received.load(std::memory_order_relaxed);
+        return samples ? m_filterNs.load(std::memory_order_relaxed) / 1000.0f / samples : 0.0f;
+    }
+
+private:
+    std::unique_ptr<GazeSource> m_source;
+    std::unique_ptr<GazeFilter> m_filter;
+    GazeTraceWriter m_recorder;
+    std::chrono::microseconds m_pollInterval{ 500 };
+    std::thread m_thread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<bool> m_finished{ false };
+    std::atomic<uint64_t> m_dropped{ 0 };
+    std::atomic<uint64_t> m_received{ 0 };
+    std::atomic<float> m_filterLagMs{ 0.0f };
+    std::atomic<float> m_filterNoiseGain{ 1.0f };
+    std::atomic<uint64_t> m_filterNs{ 0 };
+    SpscRing<GazeSample, RING_CAPACITY> m_rings[CONSUMER_COUNT];
+
+    void joinThread()
+    {
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    bool push(const GazeSample& sample) override
+    {
+        // only the ingest thread pushes, so a ring seen with room keeps it
+        for (auto& ring : m_rings)
+        {
+            if (ring.size() >= ring.capacity())
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        if (m_recorder.isOpen())
+            m_recorder.write(sample);
+        if (!m_filter)
+        {
+            for (auto& ring : m_rings)
+                ring.push(sample);
+            m_received.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // filtered only once accepted, a refused sample is offered again
+        auto start = std::chrono::steady_clock::now();
+        GazeSample filtered = sample;
+        m_filter->filter(filtered);
+        m_filterNs.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+            std::memory_order_relaxed);
+        m_filterLagMs.store(m_filter->lagMs(), std::memory_order_relaxed);
+        m_filterNoiseGain.store(m_filter->noiseGain(), std::memory_order_relaxed);
+        for (auto& ring : m_rings)
+            ring.push(filtered);
+        m_received.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void ingestLoop()
+    {
+        while (!m_stop)
+        {
+            m_source->poll(*this);
+            if (m_source->finished())
+            {
+                m_finished.store(true, std::memory_order_release);
+                return;
+            }
+            std::this_thread::sleep_for(m_pollInterval);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,438 @@
+#ifndef GAZE_PREDICTOR_H
+#define GAZE_PREDICTOR_H
+
+#include <onnxruntime_cxx_api.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gaze_ingest.h"
+#include "native_predictor.h"
+#include "saccade_detector.h"
+#include "seqlock.h"
+
+const int MAX_PREDICTION_HORIZONS = 4;
+
+// Newest prediction of the gaze model, in degrees, one point per horizon.
+struct GazePrediction
+{
+    int horizonCount;
+    float xDeg[MAX_PREDICTION_HORIZONS];
+    float yDeg[MAX_PREDICTION_HORIZONS];
+    // largest error of this horizon over the older windows of the same batch
+    // whose target time has already been observed, negative if none has
+    float errorDeg[MAX_PREDICTION_HORIZONS];
+    // tracker timestamp of the newest sample in the input window
+    int64_t inputTimestampUs;
+    float inferenceMs;
+};
+
+// How the model is driven. horizonsMs lists how far ahead each output point
+// of the model looks; a model with a single output point (the landing-point
+// predictor) uses one horizon. A model with more output points than horizons
+// is refused, as is one whose output size is not fixed. batch > 1 needs a model with a dynamic batch
+// dimension: every run then evaluates batch windows, ending at the newest
+// sample and every batchStride samples before it, in one {batch, 10, 2} call.
+// With saccadesOnly the model only runs while the saccade detector sees the eye
+// in flight (including the samples that end the saccade); during fixations the
+// newest sample already is the best estimate.
+struct GazePredictorConfig
+{
+    std::vector<float> horizonsMs = { 0.0f };
+    int batch = 1;
+    int batchStride = 8;
+    bool saccadesOnly = true;
+    SaccadeDetectorParams saccade;
+};
+
+// Runs the ONNX gaze predictor on its own thread. The worker drains its gaze
+// ring from GazeIngest, keeps the newest samples and, whenever new samples
+// arrived, runs the model and publishes the prediction of the newest window
+// through a seqlock. Windows that were overtaken by newer samples while a run
+// was in flight are skipped rather than queued. Unless the config says
+// otherwise, samples that arrive during a fixation only update the history.
+//
+// The render thread only reads the slot: it never waits for an inference and
+// uses whatever prediction is ready at frame start. Its age is the distance
+// between the newest gaze sample the renderer has seen and the newest sample
+// the prediction was made from.
+//
+// The older windows of a batch come for free in the same call. Their horizons
+// mostly point at samples that have already arrived, so they measure how far
+// off each horizon currently is.
+//
+// The steady-state loop does not touch the heap. Samples are written into a
+// mirrored history ring (each sample at slot i and i + HISTORY) so any window
+// is contiguous, the windows of a run are copied into a fixed batch buffer,
+// and the input/output tensors for every batch size are created once over
+// fixed storage, with Run() writing into the pre-bound output. --bench-predictor
+// counts the allocations of warmed iterations to keep it that way.
+//
+// useNativeEngine() swaps ORT for a NativePredictor built from the same model
+// once it reproduces ORT's outputs; ORT stays the reference and the fallback.
+class GazePredictor
+{
+public:
+    static const int WINDOW = 10;
+    static const int MAX_BATCH = 16;
+    typedef std::pair<float, float> (*ToDegrees)(float x, float y);
+
+    GazePredictor(Ort::Session& session, GazeIngest& ingest, ToDegrees toDegrees, const GazePredictorConfig& config = GazePredictorConfig())
+        : m_session(session), m_ingest(ingest), m_toDegrees(toDegrees)
+    {
+        m_horizonsMs = config.horizonsMs;
+        if (m_horizonsMs.empty())
+            m_horizonsMs.push_back(0.0f);
+        if ((int)m_horizonsMs.size() > MAX_PREDICTION_HORIZONS)
+            m_horizonsMs.resize(MAX_PREDICTION_HORIZONS);
+        m_batch = std::clamp(config.batch, 1, MAX_BATCH);
+        m_batchStride = std::max(config.batchStride, 1);
+        m_saccadesOnly = config.saccadesOnly;
+        m_detector = SaccadeDetector(config.saccade);
+
+        std::vector<int64_t> inputShape = session.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        std::vector<int64_t> outputShape = session.GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (m_batch > 1 && (inputShape.empty() || inputShape[0] != -1))
+        {
+            std::cout << "Gaze predictor: model has a fixed batch size, predicting one window per run" << std::endl;
+            m_batch = 1;
+        }
+        // the output is bound to fixed storage, so everything but the batch has to be known up front
+        int64_t outputValues = 1;
+        for (size_t i = 1; i < outputShape.size(); ++i)
+        {
+            if (outputShape[i] <= 0)
+            {
+                std::cout << "ERROR::GAZE_PREDICTOR::output dimension " << i << " of the model is not fixed" << std::endl;
+                return;
+            }
+            outputValues *= outputShape[i];
+        }
+        if (outputShape.size() < 2 || outputShape.size() > 3 || outputValues % 2 != 0
+            || outputValues / 2 > MAX_PREDICTION_HORIZONS)
+        {
+            std::cout << "ERROR::GAZE_PREDICTOR::model output must be {n, 2 * points} or {n, points, 2} with at most "
+                << MAX_PREDICTION_HORIZONS << " points" << std::endl;
+            return;
+        }
+        int pointsPerWindow = (int)(outputValues / 2);
+        if (pointsPerWindow > (int)m_horizonsMs.size())
+        {
+            // there is no horizon to attach the extra points to
+            std::cout << "ERROR::GAZE_PREDICTOR::model predicts " << pointsPerWindow << " points per window but only "
+                << m_horizonsMs.size() << " horizons were configured" << std::endl;
+            return;
+        }
+        if (pointsPerWindow < (int)m_horizonsMs.size())
+        {
+            std::cout << "Gaze predictor: model predicts " << pointsPerWindow << " points per window, using the first "
+                << pointsPerWindow << " of " << m_horizonsMs.size() << " configured horizons" << std::endl;
+            m_horizonsMs.resize(pointsPerWindow);
+        }
+        m_historySize = WINDOW + (m_batch - 1) * m_batchStride;
+        m_history.assign(2 * m_historySize, {});
+
+        int horizons = (int)m_horizonsMs.size();
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        for (int n = 1; n <= m_batch; ++n)
+        {
+            const std::array<int64_t, 3> input = { n, WINDOW, 2 };
+            m_inputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, m_batchInput.data(),
+                n * WINDOW * 2, input.data(), input.size()));
+
+            // keep the rank the model declares, {n, 2 * horizons} or {n, horizons, 2}
+            const std::array<int64_t, 3> output = { n, horizons, 2 };
+            const std::array<int64_t, 2> flat = { n, 2 * horizons };
+            if (outputShape.size() == 3)
+                m_outputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, m_batchOutput.data(),
+                    n * horizons * 2, output.data(), output.size()));
+            else
+                m_outputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, m_batchOutput.data(),
+                    n * horizons * 2, flat.data(), flat.size()));
+        }
+        m_valid = true;
+    }
+    ~GazePredictor() { stop(); }
+
+    GazePredictor(const GazePredictor&) = delete;
+    GazePredictor& operator=(const GazePredictor&) = delete;
+
+    // false if the model's output does not fit the configuration, the predictor then never runs
+    bool valid() const { return m_valid; }
+
+    void start(std::chrono::microseconds idleInterval = std::chrono::microseconds(250))
+    {
+        stop();
+        if (!m_valid)
+            return;
+        m_idleInterval = idleInterval;
+        m_stop = false;
+        m_thread = std::thread(&GazePredictor::predictLoop, this);
+    }
+    void stop()
+    {
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    // newest prediction, false (and prediction untouched) until the first one is ready
+    bool latest(GazePrediction& prediction) const
+    {
+        return m_slot.load(prediction) != 0;
+    }
+
+    // run engine instead of ORT if it matches ORT within toleranceDeg on a sweep of
+    // test windows, call before start(); prints the per-run time of both
+    bool useNativeEngine(NativePredictor& engine, float toleranceDeg)
+    {
+        if (!m_valid)
+            return false;
+        using clock = std::chrono::high_resolution_clock;
+        const int RUNS = 200;
+        const size_t outputs = (size_t)m_batch * horizonCount() * 2;
+
+        for (int k = 0; k < m_batch; ++k)
+        {
+            for (int i = 0; i < WINDOW; ++i)
+            {
+                m_batchInput[(k * WINDOW + i) * 2] = 10.0f * std::sin(0.37f * i + k);
+                m_batchInput[(k * WINDOW + i) * 2 + 1] = 5.0f * std::cos(0.23f * i + 2.0f * k);
+            }
+        }
+
+        const char* inputNames[] = { "input" };
+        const char* outputNames[] = { "output" };
+        Ort::RunOptions runOptions;
+        auto start = clock::now();
+        for (int run = 0; run < RUNS; ++run)
+            m_session.Run(runOptions, inputNames, &m_inputs[m_batch - 1], 1, outputNames, &m_outputs[m_batch - 1], 1);
+        float ortUs = std::chrono::duration<float, std::micro>(clock::now() - start).count() / RUNS;
+        std::array<float, MAX_BATCH * MAX_PREDICTION_HORIZONS * 2> expected = m_batchOutput;
+        // a value the native engine fails to write must not pass as ORT's own result
+        m_batchOutput.fill(std::numeric_limits<float>::quiet_NaN());
+
+        const int64_t shape[3] = { m_batch, WINDOW, 2 };
+        start = clock::now();
+        for (int run = 0; run < RUNS; ++run)
+        {
+            if (!engine.run(m_batchInput.data(), shape, 3, m_batchOutput.data(), outputs))
+            {
+                std::cout << "Native predictor: run failed, staying on ONNX Runtime" << std::endl;
+                return false;
+            }
+        }
+        float nativeUs = std::chrono::duration<float, std::micro>(clock::now() - start).count() / RUNS;
+
+        float maxError = 0.0f;
+        for (size_t i = 0; i < outputs; ++i)
+        {
+            float error = std::abs(m_batchOutput[i] - expected[i]);
+            if (std::isnan(error) || error > maxError)
+                maxError = error;
+        }
+        std::cout << "Native predictor: " << nativeUs << " us/run vs ONNX Runtime " << ortUs
+            << " us/run, max difference " << maxError << " deg" << std::endl;
+        if (!(maxError <= toleranceDeg))
+        {
+            std::cout << "Native predictor: outside the " << toleranceDeg << " deg tolerance, staying on ONNX Runtime" << std::endl;
+            return false;
+        }
+        m_native = &engine;
+        return true;
+    }
+
+    const char* engineName() const { return m_native ? "native" : "ONNX Runtime"; }
+
+    // one iteration of the worker: drain the new samples and run the model on
+    // them if due, true if it ran. Lets a caller drive the predictor without
+    // start(), e.g. to count the allocations of the loop on its own thread.
+    bool step()
+    {
+        using clock = std::chrono::high_resolution_clock;
+        const char* inputNames[] = { "input" };
+        const char* outputNames[] = { "output" };
+        const int horizons = horizonCount();
+        if (!m_valid)
+            return false;
+
+        bool fresh = false;
+        bool moving = false;
+        GazeSample sample;
+        while (m_ingest.pop(GazeIngest::PREDICTOR_CONSUMER, sample))
+        {
+            if (!sample.valid)
+                continue;
+            auto [xDeg, yDeg] = m_toDegrees(sample.x, sample.y);
+            m_history[m_next] = m_history[m_next + m_historySize] = { sample.timestampUs, xDeg, yDeg };
+            m_next = (m_next + 1) % m_historySize;
+            if (m_filled < m_historySize)
+                ++m_filled;
+            fresh = true;
+            // the sample that ends a saccade still counts, its run predicts the landing
+            bool wasSaccade = m_detector.inSaccade();
+            moving |= m_detector.update(sample.timestampUs, xDeg, yDeg) == SaccadeDetector::SACCADE || wasSaccade;
+        }
+
+        if (fresh && m_filled >= WINDOW && m_saccadesOnly && !moving)
+        {
+            m_skipped.fetch_add(1, std::memory_order_relaxed);
+            fresh = false;
+        }
+        if (!fresh || m_filled < WINDOW)
+            return false;
+
+        // history in time order, newest last
+        const int filled = m_filled;
+        const HistorySample* history = m_history.data() + m_next + m_historySize - filled;
+        int windows = std::min(m_batch, (filled - WINDOW) / m_batchStride + 1);
+
+        auto start = clock::now();
+        // window k ends k * stride samples before the newest one
+        for (int k = 0; k < windows; ++k)
+        {
+            const HistorySample* window = history + filled - WINDOW - k * m_batchStride;
+            float* input = m_batchInput.data() + k * WINDOW * 2;
+            for (int i = 0; i < WINDOW; ++i)
+            {
+                input[2 * i] = window[i].xDeg;
+                input[2 * i + 1] = window[i].yDeg;
+            }
+        }
+        const int64_t shape[3] = { windows, WINDOW, 2 };
+        if (!m_native || !m_native->run(m_batchInput.data(), shape, 3, m_batchOutput.data(), (size_t)windows * horizons * 2))
+        {
+            try
+            {
+                m_session.Run(m_runOptions,
+                    inputNames, &m_inputs[windows - 1], 1,
+                    outputNames, &m_outputs[windows - 1], 1);
+            }
+            catch (const Ort::Exception& e)
+            {
+                // nothing above the worker could handle it, the renderer keeps the last prediction
+                std::cout << "ERROR::GAZE_PREDICTOR::" << e.what() << std::endl;
+                m_stop = true;
+                return false;
+            }
+        }
+
+        GazePrediction prediction;
+        prediction.horizonCount = horizons;
+        for (int h = 0; h < horizons; ++h)
+        {
+            prediction.xDeg[h] = m_batchOutput[2 * h];
+            prediction.yDeg[h] = m_batchOutput[2 * h + 1];
+            prediction.errorDeg[h] = -1.0f;
+        }
+        measureErrors(prediction, history, filled, windows);
+        prediction.inputTimestampUs = history[filled - 1].timestampUs;
+        prediction.inferenceMs = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+        m_slot.store(prediction);
+        m_runs.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // model runs so far, and drains of new samples that did not run it because the eye was fixating
+    uint64_t runs() const { return m_runs.load(std::memory_order_relaxed); }
+    uint64_t skipped() const { return m_skipped.load(std::memory_order_relaxed); }
+
+    int horizonCount() const { return (int)m_horizonsMs.size(); }
+    float horizonMs(int horizon) const { return m_horizonsMs[horizon]; }
+    int batch() const { return m_batch; }
+
+    // the horizon closest to a motion-to-photon latency
+    int horizonFor(float latencyMs) const
+    {
+        int best = 0;
+        for (int i = 1; i < horizonCount(); ++i)
+        {
+            if (std::abs(m_horizonsMs[i] - latencyMs) < std::abs(m_horizonsMs[best] - latencyMs))
+                best = i;
+        }
+        return best;
+    }
+
+private:
+    struct HistorySample
+    {
+        int64_t timestampUs;
+        float xDeg;
+        float yDeg;
+    };
+
+    Ort::Session& m_session;
+    GazeIngest& m_ingest;
+    ToDegrees m_toDegrees;
+
+    bool m_valid = false;
+    std::vector<float> m_horizonsMs;
+    int m_batch = 1;
+    int m_batchStride = 8;
+    bool m_saccadesOnly = true;
+    // only touched by the worker
+    SaccadeDetector m_detector;
+
+    // mirrored sample ring, the m_historySize samples ending before slot s are m_history[s .. s + m_historySize)
+    int m_historySize = WINDOW;
+    std::vector<HistorySample> m_history;
+    // next slot to write, the oldest sample of the history once full
+    int m_next = 0;
+    int m_filled = 0;
+    std::array<float, MAX_BATCH * WINDOW * 2> m_batchInput = {};
+    std::array<float, MAX_BATCH * MAX_PREDICTION_HORIZONS * 2> m_batchOutput = {};
+    // m_inputs[n - 1] and m_outputs[n - 1] view the first n windows of the batch buffers
+    std::vector<Ort::Value> m_inputs;
+    std::vector<Ort::Value> m_outputs;
+
+    NativePredictor* m_native = nullptr;
+    Ort::RunOptions m_runOptions;
+
+    std::chrono::microseconds m_idleInterval{ 250 };
+    std::thread m_thread;
+    std::atomic<bool> m_stop{ false };
+    std::atomic<uint64_t> m_runs{ 0 };
+    std::atomic<uint64_t> m_skipped{ 0 };
+    Seqlock<GazePrediction> m_slot;
+
+    void predictLoop()
+    {
+        while (!m_stop)
+        {
+            if (!step())
+                std::this_thread::sleep_for(m_idleInterval);
+        }
+    }
+
+    // compare the older windows' predictions with the samples that arrived at their target times
+    void measureErrors(GazePrediction& prediction, const HistorySample* history, int filled, int windows) const
+    {
+        for (int k = 1; k < windows; ++k)
+        {
+            int end = filled - 1 - k * m_batchStride;
+            const float* output = m_batchOutput.data() + k * prediction.horizonCount * 2;
+            for (int h = 0; h < prediction.horizonCount; ++h)
+            {
+                int64_t target = history[end].timestampUs + (int64_t)(m_horizonsMs[h] * 1000.0f);
+                int i = end;
+                while (i < filled && history[i].timestampUs < target)
+                    ++i;
+                if (i == filled)
+                    continue;
+                float error = std::hypot(output[2 * h] - history[i].xDeg, output[2 * h + 1] - history[i].yDeg);
+                prediction.errorDeg[h] = std::max(prediction.errorDeg[h], error);
+            }
+        }
+    }
+};
+
+#endif
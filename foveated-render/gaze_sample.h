@@ -0,0 +1,18 @@
+#ifndef GAZE_SAMPLE_H
+#define GAZE_SAMPLE_H
+
+#include <cstdint>
+
+// One gaze sample as delivered by the tracker. x and y are in the tracker's
+// normalized track-rectangle coordinates, [-1, 1] from left/bottom to
+// right/top; invalid samples (lost tracking, blinks) keep their timestamp so
+// consumers can still see the gap.
+struct GazeSample
+{
+    int64_t timestampUs;
+    float x;
+    float y;
+    bool valid;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef GAZE_SOURCE_H
+#define GAZE_SOURCE_H
+
+#include "gaze_sample.h"
+
+// Receives samples from a GazeSource. push() returns false when the sample
+// could not be taken right now; live sources drop it, sources that can wait
+// (trace replay) keep it and offer it again on the next poll.
+class GazeSink
+{
+public:
+    virtual ~GazeSink() {}
+    virtual bool push(const GazeSample& sample) = 0;
+};
+
+// Anything that produces gaze samples. poll() is called repeatedly from the
+// gaze-ingest thread and hands every sample that became available since the
+// previous call to the sink, in timestamp order.
+class GazeSource
+{
+public:
+    virtual ~GazeSource() {}
+
+    virtual void poll(GazeSink& sink) = 0;
+    // true once the source will never produce another sample
+    virtual bool finished() const { return false; }
+    virtual const char* name() const = 0;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef GAZE_TRACE_H
+#define GAZE_TRACE_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "gaze_source.h"
+#include "mapped_file.h"
+
+// Binary gaze traces, little endian: a 16 byte header followed by one 16 byte
+// record per sample. The sample count is implied by the file size, so a trace
+// cut short by a crash still replays up to its last complete record.
+//
+//     header  char magic[4] = "GZTR", uint32 version, uint32 recordSize, uint32 reserved
+//     record  int64 timestampUs, float x, float y
+//
+// x and y are in GazeSample coordinates; invalid samples are stored with both
+// set to NaN.
+namespace GazeTrace
+{
+    const char MAGIC[4] = { 'G', 'Z', 'T', 'R' };
+    const uint32_t VERSION = 1;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t recordSize;
+        uint32_t reserved;
+    };
+
+    struct Record
+    {
+        int64_t timestampUs;
+        float x;
+        float y;
+    };
+
+    static_assert(sizeof(Header) == 16 && sizeof(Record) == 16, "gaze trace layout must not depend on padding");
+
+    inline Record toRecord(const GazeSample& sample)
+    {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        return { sample.timestampUs, sample.valid ? sample.x : nan, sample.valid ? sample.y : nan };
+    }
+    inline GazeSample toSample(const Record& record)
+    {
+        return { record.timestampUs, record.x, record.y, std::isfinite(record.x) && std::isfinite(record.y) };
+    }
+}
+
+// Appends samples to a trace file through a buffered stream.
+class GazeTraceWriter
+{
+public:
+    GazeTraceWriter() {}
+    ~GazeTraceWriter() { close(); }
+
+    GazeTraceWriter(const GazeTraceWriter&) = delete;
+    GazeTraceWriter& operator=(const GazeTraceWriter&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file.is_open())
+        {
+            std::cout << "ERROR::GAZE_TRACE::" << path << " cannot be opened for writing" << std::endl;
+            return false;
+        }
+        GazeTrace::Header header = {};
+        std::memcpy(header.magic, GazeTrace::MAGIC, sizeof(header.magic));
+        header.version = GazeTrace::VERSION;
+        header.recordSize = sizeof(GazeTrace::Record);
+        m_file.write((const char*)&header, sizeof(header));
+        m_count = 0;
+        return true;
+    }
+
+    void write(const GazeSample& sample)
+    {
+        GazeTrace::Record record = GazeTrace::toRecord(sample);
+        m_file.write((const char*)&record, sizeof(record));
+        ++m_count;
+    }
+
+    void close()
+    {
+        if (m_file.is_open())
+            m_file.close();
+    }
+
+    bool isOpen() const { return m_file.is_open(); }
+    uint64_t count() const { return m_count; }
+
+private:
+    std::ofstream m_file;
+    uint64_t m_count = 0;
+};
+
+// Plays a trace back from a memory mapping, so traces of any length replay
+// without being loaded into memory. REAL_TIME releases each sample once as much
+// wall-clock time has passed since the first poll as separates it from the
+// first sample; AS_FAST_AS_POSSIBLE releases samples as soon as the sink has
+// room for them. Samples keep their recorded timestamps.
+class ReplayGazeSource : public GazeSource
+{
+public:
+    enum Pacing
+    {
+        REAL_TIME,
+        AS_FAST_AS_POSSIBLE
+    };
+
+    explicit ReplayGazeSource(Pacing pacing) : m_pacing(pacing) {}
+
+    bool open(const std::string& path)
+    {
+        if (!m_file.open(path))
+        {
+            std::cout << "ERROR::GAZE_TRACE::" << path << " cannot be mapped" << std::endl;
+            return false;
+        }
+
+        GazeTrace::Header header;
+        if (m_file.size() < sizeof(header))
+        {
+            std::cout << "ERROR::GAZE_TRACE::" << path << " is too short" << std::endl;
+            return false;
+        }
+        std::memcpy(&header, m_file.data(), sizeof(header));
+        if (std::memcmp(header.magic, GazeTrace::MAGIC, sizeof(header.magic)) != 0
+            || header.version != GazeTrace::VERSION || header.recordSize != sizeof(GazeTrace::Record))
+        {
+            std::cout << "ERROR::GAZE_TRACE::" << path << " is not a version " << GazeTrace::VERSION << " gaze trace" << std::endl;
+            return false;
+        }
+
+        m_records = m_file.data() + sizeof(header);
+        m_count = (m_file.size() - sizeof(header)) / sizeof(GazeTrace::Record);
+        m_next = 0;
+        m_started = false;
+        return true;
+    }
+
+    void poll(GazeSink& sink) override
+    {
+        if (m_next >= m_count)
+            return;
+
+        int64_t releaseUntilUs = std::numeric_limits<int64_t>::max();
+        if (m_pacing == REAL_TIME)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (!m_started)
+            {
+                m_start = now;
+                m_firstTimestampUs = record(0).timestampUs;
+                m_started = true;
+            }
+            releaseUntilUs = m_firstTimestampUs + std::chrono::duration_cast<std::chrono::microseconds>(now - m_start).count();
+        }
+
+        while (m_next < m_count)
+        {
+            GazeTrace::Record next = record(m_next);
+            if (next.timestampUs > releaseUntilUs || !sink.push(GazeTrace::toSample(next)))
+                break;
+            ++m_next;
+        }
+    }
+
+    bool finished() const override { return m_next >= m_count; }
+    const char* name() const override { return m_pacing == REAL_TIME ? "trace replay" : "trace replay (fast)"; }
+
+    size_t sampleCount() const { return m_count; }
+
+private:
+    Pacing m_pacing;
+    MappedFile m_file;
+    const uint8_t* m_records = nullptr;
+    size_t m_count = 0;
+    size_t m_next = 0;
+
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_start;
+    int64_t m_firstTimestampUs = 0;
+
+    GazeTrace::Record record(size_t index) const
+    {
+        GazeTrace::Record result;
+        std::memcpy(&result, m_records + index * sizeof(GazeTrace::Record), sizeof(result));
+        return result;
+    }
+};
+
+#endif
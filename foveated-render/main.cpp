@@ -12,14 +12,44 @@
 #include "stb_image.h"
 #include "model.h"
 #include "constants.h"
+#include "shading_rate_image.h"
+#include "foveation_kernel.h"
+#include "foveation_field.h"
+#include "foveation_profile.h"
+#include "foveation_policy.h"
+#include "worker_pool.h"
+#include "gaze_filter.h"
+#include "gaze_ingest.h"
+#include "gaze_trace.h"
+#include "tobii_gaze_source.h"
+#include "mouse_gaze_source.h"
+#include "synthetic_gaze_source.h"
+#include "gaze_predictor.h"
+#include "native_predictor.h"
+#include "saccade_detector.h"
+#include "counting_allocator.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cctype>
 #include <vector>
 #include <deque>
 #include <cmath>
+#include <cstdlib>
 #include <utility>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
 
 typedef struct
 {
@@ -39,15 +69,34 @@ void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 FBO createFBO(int width, int height);
-void renderScene(Shader& shader, Model model);
+void renderScene(Shader& shader, Model& model);
 glm::vec2 gazeAngleToNorm(float x_deg, float y_deg);
 std::pair<float, float> pixelsToDegreesFromNormalized(float norm_x, float norm_y);
 float angleToNormRadius(float deg, float diagInInches, float distMM, int scrWidth, int scrHeight);
-void createFoveationTexture(glm::vec2 point, float error);
-void uploadFoveationDataToTexture(GLuint texture);
+struct FoveationRings
+{
+    float thresholdsSq[MAX_FOVEATION_THRESHOLDS];
+    int count;
+    uint8_t baseRate;
+};
+FoveationRings computeFoveationRings();
+void updateFoveationField();
+void createFoveationTexture(glm::vec2 point);
+void dispatchFoveationCompute(Shader& computeShader, glm::vec2 point);
+void verifyFoveationPaths(Shader& computeShader, glm::vec2 point);
 void setupShadingRatePalette();
-void createTexture(GLuint& glid);
+Ort::Session createPredictorSession(Ort::Env& env, const std::filesystem::path& modelPath, bool envAllocators = false);
+int bakeTextures(const std::filesystem::path& directory);
+void collectNormalMaps(const std::filesystem::path& library, std::unordered_set<std::string>& normalMaps);
+int benchFoveationKernels();
+int checkShadingRateUploads();
+int benchSceneLoad();
+GLFWwindow* createHiddenContext(int major, int minor, const char* title);
+int compareShadingRateUploads();
+int benchPredictorAllocations(GazePredictor& predictor, const CountingOrtAllocator& ortAllocator);
+int compareInt8Predictor(Ort::Session& fp32, Ort::Session& int8, const std::string& tracePath);
 bool InitNVShadingRateImageExtensions();
 template <typename T>
 bool LoadGLFunction(T& funcPtr, const char* name);
@@ -66,19 +115,32 @@ float near = 0.1f;
 float far = 10000.0f;
 float INNER_R_DEG = 6.5f;
 float MIDDLE_R_DEG = 14.25f;
-float INNER_R = angleToNormRadius(INNER_R_DEG, diagonal_in_inches, DIST_MM, SCR_WIDTH, SCR_HEIGHT);
-float MIDDLE_R = angleToNormRadius(MIDDLE_R_DEG, diagonal_in_inches, DIST_MM, SCR_WIDTH, SCR_HEIGHT);
 
 float posX = 0.5;
 float posY = 0.5;
 
+// the scene drawn, and loaded by --bench-scene-load
+std::string SCENE_PATH = "C:/Users/loenardomm8/Documents/sponza_2/sponza.obj";
+
 // VRS stuff
-GLuint fov_texture;
-std::vector<uint8_t> m_shadingRateImageData;
-uint32_t m_shadingRateImageWidth = 0;
-uint32_t m_shadingRateImageHeight = 0;
-GLint m_shadingRateImageTexelWidth;
-GLint m_shadingRateImageTexelHeight;
+ShadingRateImage shadingRateImage;
+// foveation maps with at least this many texels are split into row bands across the pool
+unsigned FOVEATION_WORKERS = 3;
+uint32_t FOVEATION_PARALLEL_MIN_TEXELS = 1 << 16;
+WorkerPool foveationPool(FOVEATION_WORKERS);
+FoveationField foveationField;
+FoveationProfile foveationProfile = FoveationProfile::defaults(INNER_R_DEG, MIDDLE_R_DEG);
+FoveationPolicy foveationPolicy;
+GLuint foveationFieldBuffer = 0;
+uint32_t foveationFieldBufferGeneration = 0;
+
+// EYE TRACKING
+GazeIngest gazeIngest;
+// set when the mouse drives the gaze, owned by gazeIngest
+MouseGazeSource* mouseGazeSource = nullptr;
+// runs on the render thread's copy of the gaze stream and drives isSaccade,
+// built from predictorConfig.saccade like the predictor's own detector
+SaccadeDetector saccadeDetector;
 
 // CAMERA
 Camera camera(glm::vec3(0.0f, 2.0f, 8.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, 0.0f);
@@ -90,50 +152,216 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 bool showShading = false;
+bool useComputeFoveation = false;
+bool verifyFoveation = false;
 bool isCursorEnabled = false;
 bool isSaccade = false;
 bool isLastSaccade = false;
+// shade the whole frame at the coarsest rate while the eye is in a saccade
+bool saccadicSuppression = true;
 
 float PRECISION_DEG = 1.01f; //https://link.springer.com/chapter/10.1007/978-3-030-98404-5_36
-float PRECISION = angleToNormRadius(PRECISION_DEG, diagonal_in_inches, DIST_MM, SCR_WIDTH, SCR_HEIGHT);
+// tracker latency not visible in the sample timestamps, added to the measured motion-to-photon latency
+float TRACKER_LATENCY_MS = 0.0f;
+// largest output difference to ORT, in degrees, for the native predictor to be used
+float NATIVE_PREDICTOR_TOLERANCE_DEG = 0.01f;
 
 using namespace TobiiGameIntegration;
 
-int main()
+int main(int argc, char* argv[])
 {
+    // command line
+    std::string gazeSourceName = "tobii";
+    std::string replayPath;
+    std::string recordPath;
+    bool fastReplay = false;
+    float gazeRateHz = 0.0f;
+    GazePredictorConfig predictorConfig;
+    bool int8Predictor = false;
+    bool nativePredictor = false;
+    std::string gazeFilterName = "none";
+    GazeFilterParams filterParams;
+    std::string bakeTexturesPath;
+    bool benchFoveation = false;
+    bool checkUploads = false;
+    bool benchScene = false;
+    bool benchPredictor = false;
+    std::string compareInt8Path;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--gaze" && i + 1 < argc)
+            gazeSourceName = argv[++i];
+        else if (arg == "--rate" && i + 1 < argc)
+            gazeRateHz = (float)std::atof(argv[++i]);
+        else if (arg == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--fast")
+            fastReplay = true;
+        else if (arg == "--horizons" && i + 1 < argc)
+        {
+            // comma separated, in milliseconds
+            predictorConfig.horizonsMs.clear();
+            std::stringstream list(argv[++i]);
+            std::string horizon;
+            while (std::getline(list, horizon, ','))
+                predictorConfig.horizonsMs.push_back((float)std::atof(horizon.c_str()));
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+            predictorConfig.batch = std::atoi(argv[++i]);
+        else if (arg == "--int8")
+            int8Predictor = true;
+        else if (arg == "--native")
+            nativePredictor = true;
+        else if (arg == "--predict-always")
+            predictorConfig.saccadesOnly = false;
+        else if (arg == "--filter" && i + 1 < argc)
+            gazeFilterName = argv[++i];
+        else if (arg == "--filter-budget" && i + 1 < argc)
+            filterParams.latencyBudgetMs = (float)std::atof(argv[++i]);
+        else if (arg == "--bake-textures" && i + 1 < argc)
+            bakeTexturesPath = argv[++i];
+        else if (arg == "--bench-foveation")
+            benchFoveation = true;
+        else if (arg == "--check-uploads")
+            checkUploads = true;
+        else if (arg == "--bench-scene-load")
+            benchScene = true;
+        else if (arg == "--bench-predictor")
+            benchPredictor = true;
+        else if (arg == "--compare-int8" && i + 1 < argc)
+            compareInt8Path = argv[++i];
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--gaze tobii|mouse|synthetic] [--rate hz]"
+                << " [--replay trace.gaze [--fast]] [--record trace.gaze]"
+                << " [--horizons ms,ms,...] [--batch windows] [--int8] [--native] [--predict-always]"
+                << " [--filter none|one-euro|kalman [--filter-budget ms]] [--bake-textures directory]"
+                << " [--bench-foveation] [--check-uploads] [--bench-scene-load] [--bench-predictor] [--compare-int8 trace.gaze]" << std::endl;
+            return -1;
+        }
+    }
+
+    // offline texture compression, needs no window or tracker
+    if (!bakeTexturesPath.empty())
+        return bakeTextures(bakeTexturesPath);
+    if (benchFoveation)
+        return benchFoveationKernels();
+    if (checkUploads)
+        return checkShadingRateUploads();
+    if (benchScene)
+        return benchSceneLoad();
+
+    // the INT8 variant is the quantized export of the same predictor, next to it
+    const std::filesystem::path fp32ModelPath = "C:/Users/loenardomm8/Documents/gaze1_predictor.onnx";
+    const std::filesystem::path int8ModelPath = std::filesystem::path(fp32ModelPath).replace_extension(".int8.onnx");
+    if (!compareInt8Path.empty())
+    {
+        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "saccade_predictor");
+        Ort::Session fp32 = createPredictorSession(env, fp32ModelPath);
+        Ort::Session int8 = createPredictorSession(env, int8ModelPath);
+        return compareInt8Predictor(fp32, int8, compareInt8Path);
+    }
+
     //Eye tracking data
-    ITobiiGameIntegrationApi* api = GetApi("Gaze Sample");
-    IStreamsProvider* streamsProvider = api->GetStreamsProvider();
-    ITrackerController* trackerController = api->GetTrackerController();
+    std::unique_ptr<GazeSource> gazeSource;
+    if (!replayPath.empty())
+    {
+        auto replay = std::make_unique<ReplayGazeSource>(fastReplay ? ReplayGazeSource::AS_FAST_AS_POSSIBLE : ReplayGazeSource::REAL_TIME);
+        if (!replay->open(replayPath))
+            return -1;
+        std::cout << "Replaying " << replay->sampleCount() << " gaze samples from " << replayPath << std::endl;
+        gazeSource = std::move(replay);
+    }
+    else if (gazeSourceName == "mouse")
+    {
+        auto mouse = std::make_unique<MouseGazeSource>(gazeRateHz > 0.0f ? gazeRateHz : 1000.0f);
+        mouseGazeSource = mouse.get();
+        gazeSource = std::move(mouse);
+    }
+    else if (gazeSourceName == "synthetic")
+    {
+        SyntheticGazeParams params;
+        if (gazeRateHz > 0.0f)
+            params.sampleRateHz = gazeRateHz;
+        params.screenWidthMM = SCR_WIDTH_MM;
+        params.screenHeightMM = SCR_HEIGHT_MM;
+        params.viewingDistanceMM = DIST_MM;
+        gazeSource = std::make_unique<SyntheticGazeSource>(params);
+    }
+    else if (gazeSourceName == "tobii")
+    {
+        ITobiiGameIntegrationApi* api = GetApi("Gaze Sample");
+        ITrackerController* trackerController = api->GetTrackerController();
 
-    api->GetTrackerController()->TrackRectangle({ 0,0,SCR_WIDTH,SCR_HEIGHT });
-    const GazePoint* gazePoints = nullptr;
-    TrackerInfo info;
-    bool success = trackerController->GetTrackerInfo(info);
+        api->GetTrackerController()->TrackRectangle({ 0,0,SCR_WIDTH,SCR_HEIGHT });
+        TrackerInfo info;
+        bool success = trackerController->GetTrackerInfo(info);
 
-    if (success) {
-        std::cout << "=== Tobii Eye Tracker Info ===" << std::endl;
+        if (success) {
+            std::cout << "=== Tobii Eye Tracker Info ===" << std::endl;
 
-        std::cout << "Model: " << info.ModelName << std::endl;
-    } else {
-        std::cerr << "Failed to retrieve tracker info." << std::endl;
+            std::cout << "Model: " << info.ModelName << std::endl;
+        } else {
+            std::cerr << "Failed to retrieve tracker info." << std::endl;
+        }
+        gazeSource = std::make_unique<TobiiGazeSource>(api);
     }
+    else
+    {
+        std::cout << "Unknown gaze source '" << gazeSourceName << "'" << std::endl;
+        return -1;
+    }
+    if (!recordPath.empty() && !gazeIngest.record(recordPath))
+        return -1;
 
-    std::deque<std::array<float, 2>> gaze_history;
+    // tracker units to degrees at the screen edge, the filters work in degrees
+    std::tie(filterParams.degreesPerUnitX, filterParams.degreesPerUnitY) = pixelsToDegreesFromNormalized(1.0f, 1.0f);
+    if (gazeFilterName == "one-euro")
+        gazeIngest.filter(std::make_unique<OneEuroGazeFilter>(filterParams));
+    else if (gazeFilterName == "kalman")
+        gazeIngest.filter(std::make_unique<KalmanGazeFilter>(filterParams));
+    else if (gazeFilterName != "none")
+    {
+        std::cout << "Unknown gaze filter '" << gazeFilterName << "'" << std::endl;
+        return -1;
+    }
     glm::vec2 predicted;
-    std::pair<float, float> predicted_deg;
 
     Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "saccade_predictor");
-    Ort::SessionOptions session_options;
-    session_options.SetIntraOpNumThreads(1);
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    std::array<int64_t, 3> input_shape = { 1, 10, 2 };
-    const char* input_names[] = { "input" };
-    const char* output_names[] = { "output" };
+
+    // --bench-predictor has the session allocate through this to count ORT's heap use,
+    // declared first so it outlives the session
+    CountingOrtAllocator ortAllocator;
+    if (benchPredictor)
+        env.RegisterAllocator(&ortAllocator);
 
     // Load the model
-    const wchar_t* model_path = L"C:/Users/loenardomm8/Documents/gaze1_predictor.onnx";
-    Ort::Session session(env, model_path, session_options);
+    std::filesystem::path model_path = int8Predictor ? int8ModelPath : fp32ModelPath;
+    Ort::Session session = createPredictorSession(env, model_path, benchPredictor);
+
+    // from here on the gaze source is only touched by the ingest thread
+    std::cout << "Gaze source: " << gazeSource->name() << ", filter: " << gazeIngest.filterName() << std::endl;
+    gazeIngest.start(std::move(gazeSource));
+    // every fresh sample runs the model while benchmarking, not just the saccades
+    if (benchPredictor)
+        predictorConfig.saccadesOnly = false;
+    GazePredictor predictor(session, gazeIngest, pixelsToDegreesFromNormalized, predictorConfig);
+    if (!predictor.valid())
+        return -1;
+    // same samples, same thresholds: the render thread and the predictor agree on every saccade
+    saccadeDetector = SaccadeDetector(predictorConfig.saccade);
+    // validated against the ORT session at startup, ORT keeps running the model on any mismatch
+    NativePredictor nativeEngine;
+    if (nativePredictor && nativeEngine.load(model_path.string()))
+        predictor.useNativeEngine(nativeEngine, NATIVE_PREDICTOR_TOLERANCE_DEG);
+    if (benchPredictor)
+        return benchPredictorAllocations(predictor, ortAllocator);
+    predictor.start();
+    std::cout << "Gaze predictor: " << predictor.engineName() << ", " << predictor.horizonCount() << " horizon(s), "
+        << predictor.batch() << " window(s) per run" << std::endl;
 
     // glfw: initialize and configure
     glfwInit();
@@ -160,6 +388,7 @@ int main()
     glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 
 
     if (!InitNVShadingRateImageExtensions()) {
@@ -177,22 +406,30 @@ int main()
     glEnable(NVShadingRate::IMAGE);
 
 
-    glGetIntegerv(NVShadingRate::TEXEL_HEIGHT, &m_shadingRateImageTexelHeight);
-    glGetIntegerv(NVShadingRate::TEXEL_WIDTH, &m_shadingRateImageTexelWidth);
-
-    m_shadingRateImageWidth = (SCR_WIDTH + m_shadingRateImageTexelWidth - 1) / m_shadingRateImageTexelWidth;
-    m_shadingRateImageHeight = (SCR_HEIGHT + m_shadingRateImageTexelHeight - 1) / m_shadingRateImageTexelHeight;
-    m_shadingRateImageData.resize(m_shadingRateImageWidth * m_shadingRateImageHeight);
-
-    createTexture(fov_texture);
+    // glad only loads glBufferStorage as part of GL 4.4, not from GL_ARB_buffer_storage
+    bool hasBufferStorage = GLAD_GL_VERSION_4_4;
+    shadingRateImage.init(hasBufferStorage);
+    // shading rates apply while drawing into fboHigh, so the image covers that
+    // render target rather than the window; resize it wherever fboHigh is reallocated
+    shadingRateImage.resize(SCR_WIDTH, SCR_HEIGHT);
+    if (!FoveationKernel::verify())
+    {
+        std::cout << "ERROR::FOVEATION_KERNEL::" << FoveationKernel::rowFuncName() << " differs from the scalar reference" << std::endl;
+        return -1;
+    }
+    std::cout << "Foveation kernel: " << FoveationKernel::rowFuncName() << std::endl;
+    std::cout << "Shading rate image uploads: " << (shadingRateImage.isStreaming() ? "persistent PBO ring" : "synchronous") << std::endl;
+    foveationProfile.loadFromFile("foveation.cfg");
     setupShadingRatePalette();
+    foveationPolicy.reset(foveationProfile);
 
     Shader shader("vrs.vs", "vrs.fs");
     Shader screenShader("screen.vs", "screen.fs");
+    Shader foveationShader("foveation.comp");
     shader.use();
 
-    std::string path = "C:/Users/loenardomm8/Documents/sponza_2/sponza.obj";
-    Model conference(path);
+    // released before the context goes away, it holds GL textures
+    auto conference = std::make_unique<Model>(SCENE_PATH);
 
     GLenum err;
     while ((err = glGetError()) != GL_NO_ERROR)
@@ -230,8 +467,9 @@ int main()
         glm::vec3(135.0f, 60.0f, -81.0f) };
 
 
-    int count = 0;
-    const GazePoint* last = nullptr;
+    GazeSample last = {};
+    bool hasGaze = false;
+    float motion_to_photon_ms = 0.0f;
     using clock = std::chrono::high_resolution_clock;
 
     while (!glfwWindowShouldClose(window))
@@ -242,56 +480,87 @@ int main()
         float fps = 1.0f / deltaTime;
         //std::cout << "FPS: " << fps << std::endl;
 
-        // ========== API UPDATE ==========
-        auto t0 = clock::now();
-        api->Update();
-        auto t1 = clock::now();
-
-        // ========== GET GAZE POINTS ==========
-        int count = streamsProvider->GetGazePoints(gazePoints);
-        auto t2 = clock::now();
-        if (gazePoints != nullptr) {
-            for (int i = 0; i < count; ++i) {
-                const GazePoint& point = gazePoints[i];
-                last = &gazePoints[i];
-                auto [gaze_deg_x, gaze_deg_y] = pixelsToDegreesFromNormalized(point.X, point.Y);
-                gaze_history.push_back({ gaze_deg_x, gaze_deg_y });
-            }
+        // ========== DRAIN GAZE SAMPLES ==========
+        int samples = 0;
+        // read before draining, samples pushed just before the source finished are still seen
+        bool gazeFinished = gazeIngest.finished();
+        isLastSaccade = isSaccade;
+        bool sawSaccade = false;
+        GazeSample sample;
+        while (gazeIngest.pop(GazeIngest::RENDER_CONSUMER, sample)) {
+            ++samples;
+            if (!sample.valid)
+                continue;
+            last = sample;
+            hasGaze = true;
+            auto [sample_deg_x, sample_deg_y] = pixelsToDegreesFromNormalized(sample.x, sample.y);
+            sawSaccade |= saccadeDetector.update(sample.timestampUs, sample_deg_x, sample_deg_y) == SaccadeDetector::SACCADE;
+        }
+        isSaccade = saccadeDetector.inSaccade();
+        // first frame after a saccade, also when a short one started and ended within this frame's samples
+        bool landing = !isSaccade && (isLastSaccade || sawSaccade);
+        if (samples == 0 && gazeFinished)
+        {
+            std::cout << "Gaze replay finished" << std::endl;
+            glfwSetWindowShouldClose(window, true);
         }
 
-        // ========== TIME PROCESSING AND INFERENCE ==========
-        auto t3 = clock::now();
-        if (gaze_history.size() > 10) gaze_history.pop_front();
-
-        if (gaze_history.size() == 10) {
-            auto& prev = gaze_history[gaze_history.size() - 2];
-            auto& curr = gaze_history.back();
-
-            float dx = predicted_deg.first - curr[0];
-            float dy = predicted_deg.second - curr[1];
-            float raw_error = std::sqrt(dx * dx + dy * dy);
-            float total_error = std::sqrt(raw_error * raw_error + PRECISION * PRECISION);
-            std::cout << total_error << std::endl;
-
-            std::vector<float> input_tensor_values;
-            for (const auto& pt : gaze_history) {
-                input_tensor_values.push_back(pt[0]);
-                input_tensor_values.push_back(pt[1]);
+        // ========== PICK UP PREDICTION ==========
+        float t_fov = 0.0f;
+        float prediction_age_ms = 0.0f;
+        float t_infer = 0.0f;
+        GazePrediction prediction;
+
+        // Fixations are foveated on the newest sample and skip the predictor. It
+        // runs during saccades, where the whole frame is shaded coarsely anyway,
+        // so its landing prediction is ready for the frame the saccade ends in.
+        bool predicting = !predictorConfig.saccadesOnly || isSaccade || landing;
+        if (hasGaze) {
+            glm::vec2 center((last.x + 1.0) / 2.0, (last.y + 1) / 2.0);
+            float raw_error = 0.0f;
+
+            // a prediction from before this saccade says nothing about where it lands
+            if (predicting && predictor.latest(prediction)
+                && (!predictorConfig.saccadesOnly || prediction.inputTimestampUs >= saccadeDetector.saccadeStartUs())) {
+                auto [gaze_deg_x, gaze_deg_y] = pixelsToDegreesFromNormalized(last.x, last.y);
+                prediction_age_ms = std::max(0.0f, (last.timestampUs - prediction.inputTimestampUs) / 1000.0f);
+                t_infer = prediction.inferenceMs;
+
+                // the prediction has to cover its own age plus the time until this frame is on screen
+                float latency_ms = prediction_age_ms + deltaTime * 1000.0f + TRACKER_LATENCY_MS + gazeIngest.filterLagMs();
+                motion_to_photon_ms += (latency_ms - motion_to_photon_ms) * 0.1f;
+                int horizon = predictor.horizonFor(motion_to_photon_ms);
+
+                raw_error = prediction.errorDeg[horizon];
+                if (raw_error < 0.0f)
+                {
+                    float dx = prediction.xDeg[horizon] - gaze_deg_x;
+                    float dy = prediction.yDeg[horizon] - gaze_deg_y;
+                    raw_error = std::sqrt(dx * dx + dy * dy);
+                }
+                predicted = gazeAngleToNorm(prediction.xDeg[horizon], prediction.yDeg[horizon]);
+                // the tracker still lags the eye, foveate where the saccade is predicted to land
+                if (landing)
+                    center = predicted;
             }
+            // the filter takes its share of the tracker noise off the precision bound
+            float precision_deg = PRECISION_DEG * gazeIngest.filterNoiseGain();
+            float total_error = std::sqrt(raw_error * raw_error + precision_deg * precision_deg);
+            std::cout << total_error << std::endl;
 
-            Ort::Value input_tensor = Ort::Value::CreateTensor<float>(memory_info, input_tensor_values.data(),
-                input_tensor_values.size(), input_shape.data(), input_shape.size());
-
-            auto output_tensors = session.Run(Ort::RunOptions{ nullptr },
-                input_names, &input_tensor, 1,
-                output_names, 1);
-
-            float* output = output_tensors.front().GetTensorMutableData<float>();
-            predicted_deg = { output[0], output[1] };
-            predicted = gazeAngleToNorm(predicted_deg.first, predicted_deg.second);
-            createFoveationTexture(glm::vec2((last->X + 1.0) / 2.0, (last->Y + 1) / 2.0), total_error);
-            //createFoveationTexture(predicted, total_error);
+            auto fov_start = clock::now();
+            foveationPolicy.update(total_error, prediction_age_ms / 1000.0f, deltaTime);
+            if (useComputeFoveation)
+                dispatchFoveationCompute(foveationShader, center);
+            else
+                createFoveationTexture(center);
+            t_fov = std::chrono::duration<float, std::milli>(clock::now() - fov_start).count();
 
+            if (verifyFoveation)
+            {
+                verifyFoveationPaths(foveationShader, center);
+                verifyFoveation = false;
+            }
         }
         auto t4 = clock::now();
 
@@ -303,9 +572,9 @@ int main()
 
         shader.use();
         glEnable(NVShadingRate::IMAGE);
-        createTexture(fov_texture);
-        uploadFoveationDataToTexture(fov_texture);
-        glBindShadingRateImageNV(fov_texture);
+        if (!useComputeFoveation)
+            shadingRateImage.upload();
+        glBindShadingRateImageNV(shadingRateImage.texture());
 
         shader.setMat4("view", view);
         shader.setMat4("projection", projection);
@@ -323,7 +592,7 @@ int main()
         glBindFramebuffer(GL_FRAMEBUFFER, fboHigh.fbo);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         shader.setBool("showShading", showShading);
-        renderScene(shader, conference);
+        renderScene(shader, *conference);
 
         glDisable(GL_DEPTH_TEST);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -335,8 +604,8 @@ int main()
         screenShader.setBool("showShading", showShading);
         screenShader.setInt("screenTexture", 0);
         screenShader.setVec2("predicted", predicted);
-        if (gaze_history.size() > 0)
-            screenShader.setVec2("true_gaze", glm::vec2((last->X + 1.0) / 2.0, (last->Y + 1) / 2.0));
+        if (hasGaze)
+            screenShader.setVec2("true_gaze", glm::vec2((last.x + 1.0) / 2.0, (last.y + 1) / 2.0));
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
         auto t5 = clock::now();
@@ -344,17 +613,18 @@ int main()
         glfwSwapBuffers(window);
         glfwPollEvents();
 
-        float t_api = std::chrono::duration<float, std::milli>(t1 - t0).count();
-        float t_gaze = std::chrono::duration<float, std::milli>(t2 - t1).count();
-        float t_infer = std::chrono::duration<float, std::milli>(t4 - t3).count();
         float t_render = std::chrono::duration<float, std::milli>(t5 - t4).count();
         float t_total = std::chrono::duration<float, std::milli>(t5 - frame_start).count();
 
-        std::cout << "[ms] API: " << t_api
-            << " | Gaze: " << t_gaze
-            << " | Infer: " << t_infer
+        std::cout << "[ms] Infer (async): " << t_infer
+            << " | Prediction age: " << prediction_age_ms
+            << " | Motion-to-photon: " << motion_to_photon_ms
+            << " | Filter lag: " << gazeIngest.filterLagMs()
+            << " | Fov: " << t_fov
             << " | Render: " << t_render
-            << " | Total: " << t_total << std::endl;
+            << " | Total: " << t_total
+            << " | Samples: " << samples
+            << " | Saccade: " << isSaccade << std::endl;
 
         // dt
         float currentFrame = glfwGetTime();
@@ -365,11 +635,19 @@ int main()
             std::cout << "After process: GL Error " << err << std::endl;
 }
 
+    predictor.stop();
+    std::cout << "Gaze predictor: " << predictor.runs() << " runs, " << predictor.skipped()
+        << " sample batches skipped during fixations, " << saccadeDetector.saccadeCount() << " saccades" << std::endl;
+    gazeIngest.stop();
+    std::cout << "Gaze filter: " << gazeIngest.filterName() << ", " << gazeIngest.filterCostUs() << " us per sample" << std::endl;
+    conference.reset();
+    shadingRateImage.destroy();
+    glDeleteBuffers(1, &foveationFieldBuffer);
     glfwTerminate();
     return 0;
 }
 
-void renderScene(Shader& shader, Model model)
+void renderScene(Shader& shader, Model& model)
 {
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -418,6 +696,28 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
     }
 }
 
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_G)
+    {
+        useComputeFoveation = !useComputeFoveation;
+        // the compute pass overwrote the texture, the CPU copy has to be resent in full
+        if (!useComputeFoveation)
+            shadingRateImage.invalidate();
+        std::cout << "Foveation map: " << (useComputeFoveation ? "compute shader" : "CPU") << std::endl;
+    }
+    if (key == GLFW_KEY_V)
+        verifyFoveation = true;
+    if (key == GLFW_KEY_B)
+    {
+        saccadicSuppression = !saccadicSuppression;
+        std::cout << "Saccadic suppression: " << (saccadicSuppression ? "on" : "off") << std::endl;
+    }
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
     const float sensitivity = 0.3f;
@@ -429,6 +729,8 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
         posY += yoffset_fov;
         posX = std::clamp(posX, 0.f, 1.f);
         posY = std::clamp(posY, 0.f, 1.f);
+        if (mouseGazeSource)
+            mouseGazeSource->setPosition(posX, posY);
         return;
     }
     if (firstMouse)
@@ -535,29 +837,28 @@ float angleToNormRadius(float deg, float diagInInches, float distMM, int scrWidt
     return (sizePx / screenSizePx) / 2.0f;  // radius
 }
 
-void createTexture(GLuint& glid)
-{
-    if (glid)
-    {
-        glDeleteTextures(1, &glid);
-    }
-    glGenTextures(1, &glid);
-}
-
 void setupShadingRatePalette()
 {
     GLint palSize;
     glGetIntegerv(NVShadingRate::PALETTE_SIZE, &palSize);
     assert(palSize >= 4);
 
+    // the palette has to hold NO_INVOCATIONS plus every profile level
+    if ((int)foveationProfile.levels.size() > palSize - 1)
+    {
+        std::cerr << "Foveation profile has " << foveationProfile.levels.size() << " levels, palette only fits " << palSize - 1 << std::endl;
+        foveationProfile.levels.resize(palSize - 1);
+    }
+
     GLenum* palette = new GLenum[palSize];
 
     palette[0] = NVShadingRate::NO_INVOCATIONS;
-    palette[1] = NVShadingRate::ONE_INVOCATION_PER_PIXEL;
-    palette[2] = NVShadingRate::ONE_INVOCATION_PER_2X2;
-    palette[3] = NVShadingRate::ONE_INVOCATION_PER_4X4;
+    for (size_t i = 0; i < foveationProfile.levels.size(); ++i)
+    {
+        palette[i + 1] = foveationProfile.levels[i].rate;
+    }
 
-    for (int i = 4; i < palSize; ++i)
+    for (int i = (int)foveationProfile.levels.size() + 1; i < palSize; ++i)
     {
         palette[i] = NVShadingRate::ONE_INVOCATION_PER_PIXEL;
     }
@@ -566,47 +867,710 @@ void setupShadingRatePalette()
     delete[] palette;
 }
 
-void createFoveationTexture(glm::vec2 point, float error)
+// current ring radii of the foveation policy, compared on squared eccentricities
+FoveationRings computeFoveationRings()
+{
+    // level i is palette index i + 1
+    FoveationRings rings;
+    rings.count = foveationPolicy.ringCount();
+    rings.baseRate = 1;
+
+    // nothing is seen sharply mid-saccade, every texel is past every ring
+    bool suppressed = isSaccade && saccadicSuppression;
+    for (int i = 0; i < rings.count; ++i)
+    {
+        float radius = suppressed ? 0.0f : foveationPolicy.radius(i);
+        rings.thresholdsSq[i] = radius * radius;
+    }
+    return rings;
+}
+
+// rebuild the eccentricity table when the shading rate image or screen geometry changed
+void updateFoveationField()
+{
+    const int width = shadingRateImage.width();
+    const int height = shadingRateImage.height();
+
+    FoveationGeometry geometry;
+    geometry.texelWidthMM = shadingRateImage.texelWidth() * SCR_WIDTH_MM / SCR_WIDTH;
+    geometry.texelHeightMM = shadingRateImage.texelHeight() * SCR_HEIGHT_MM / SCR_HEIGHT;
+    geometry.viewingDistanceMM = DIST_MM;
+    geometry.verticalScale = foveationProfile.verticalScale;
+
+    if (!foveationField.matches(width, height, geometry))
+        foveationField.build(width, height, geometry);
+}
+
+void createFoveationTexture(glm::vec2 point)
 {
-    float centerX = point[0];
-    float centerY = point[1];
-    const int width = m_shadingRateImageWidth;
-    const int height = m_shadingRateImageHeight;
+    const int width = shadingRateImage.width();
+    const int height = shadingRateImage.height();
+    uint8_t* data = shadingRateImage.data();
 
-    float scale = 0.1f; 
-    float dynamicError = error * scale;
-    float innerR = INNER_R + dynamicError;
-    float middleR = MIDDLE_R + dynamicError;
+    updateFoveationField();
+    int centerX, centerY;
+    foveationField.centerTexel(point[0], point[1], centerX, centerY);
 
-    for (int y = 0; y < height; ++y)
+    const FoveationRings rings = computeFoveationRings();
+
+    FoveationKernel::RowFunc classifyRow = FoveationKernel::rowFunc();
+    const FoveationKernel::RowParams params = { width, nullptr, rings.thresholdsSq, rings.count, rings.baseRate };
+
+    // bounding box of texels whose rate changed since the previous map, per band
+    struct Band
+    {
+        int minX, minY, maxX, maxY;
+    };
+    const int maxBands = 16;
+    Band bands[maxBands];
+
+    bool parallel = (uint32_t)(width * height) >= FOVEATION_PARALLEL_MIN_TEXELS && foveationPool.concurrency() > 1;
+    int bandCount = parallel ? std::min<int>(std::min<int>(maxBands, 2 * foveationPool.concurrency()), height) : 1;
+
+    auto classifyBand = [&](int band)
     {
-        for (int x = 0; x < width; ++x)
+        int y0 = height * band / bandCount;
+        int y1 = height * (band + 1) / bandCount;
+        FoveationKernel::RowParams rowParams = params;
+        Band& box = bands[band];
+        box = { width, height, -1, -1 };
+
+        for (int y = y0; y < y1; ++y)
         {
-            float fx = x / (float)width;
-            float fy = y / (float)height;
+            rowParams.distanceSq = foveationField.row(y, centerX, centerY);
 
-            float d = std::sqrt((fx - centerX) * (fx - centerX) + (fy - centerY) * (fy - centerY));
-            if (d < (innerR))
+            int first = width, last = -1;
+            classifyRow(data + y * width, rowParams, first, last);
+            if (last >= 0)
             {
-                m_shadingRateImageData[x + y * width] = 1;
+                box.minX = std::min(box.minX, first);
+                box.maxX = std::max(box.maxX, last);
+                box.minY = std::min(box.minY, y);
+                box.maxY = y;
             }
-            else if (d < (MIDDLE_R))
+        }
+    };
+
+    if (parallel)
+        foveationPool.run(bandCount, classifyBand);
+    else
+        classifyBand(0);
+
+    for (int band = 0; band < bandCount; ++band)
+    {
+        const Band& box = bands[band];
+        if (box.maxX >= 0)
+            shadingRateImage.markDirty(box.minX, box.minY, box.maxX + 1, box.maxY + 1);
+    }
+}
+
+void dispatchFoveationCompute(Shader& computeShader, glm::vec2 point)
+{
+    const int width = shadingRateImage.width();
+    const int height = shadingRateImage.height();
+    const FoveationRings rings = computeFoveationRings();
+
+    updateFoveationField();
+    if (!foveationFieldBuffer || foveationFieldBufferGeneration != foveationField.generation())
+    {
+        if (!foveationFieldBuffer)
+            glGenBuffers(1, &foveationFieldBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, foveationFieldBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, foveationField.size() * sizeof(float), foveationField.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        foveationFieldBufferGeneration = foveationField.generation();
+    }
+    int centerX, centerY;
+    foveationField.centerTexel(point[0], point[1], centerX, centerY);
+
+    computeShader.use();
+    computeShader.setInt("centerX", centerX);
+    computeShader.setInt("centerY", centerY);
+    for (int i = 0; i < rings.count; ++i)
+        computeShader.setFloat("thresholdsSq[" + std::to_string(i) + "]", rings.thresholdsSq[i]);
+    computeShader.setInt("thresholdCount", rings.count);
+    computeShader.setUint("baseRate", rings.baseRate);
+
+    glBindImageTexture(0, shadingRateImage.texture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, foveationFieldBuffer);
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+// runs both generators for the same gaze and reports how many texels differ
+void verifyFoveationPaths(Shader& computeShader, glm::vec2 point)
+{
+    const int width = shadingRateImage.width();
+    const int height = shadingRateImage.height();
+
+    createFoveationTexture(point);
+    dispatchFoveationCompute(computeShader, point);
+
+    std::vector<uint8_t> gpuMap(width * height);
+    glBindTexture(GL_TEXTURE_2D, shadingRateImage.texture());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, gpuMap.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const uint8_t* cpuMap = shadingRateImage.data();
+    int mismatches = 0;
+    for (int i = 0; i < width * height; ++i)
+        mismatches += cpuMap[i] != gpuMap[i];
+
+    std::cout << "Foveation map CPU vs compute: " << mismatches << " of " << width * height << " texels differ" << std::endl;
+
+    // the texture now holds the compute result, resend the CPU map if that is the active path
+    if (!useComputeFoveation)
+        shadingRateImage.invalidate();
+}
+
+// Sessions run with ORT's extended graph optimizations. The optimized graph is
+// written next to the model (<model>.opt.onnx) on the first start and loaded
+// with optimizations disabled afterwards, until the source model is newer
+// than the cache.
+// envAllocators makes the session allocate through the allocators registered with env
+Ort::Session createPredictorSession(Ort::Env& env, const std::filesystem::path& modelPath, bool envAllocators)
+{
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
+    std::filesystem::path cachePath = modelPath;
+    cachePath.replace_extension(".opt.onnx");
+
+    std::error_code ec;
+    bool cached = std::filesystem::exists(cachePath, ec)
+        && std::filesystem::last_write_time(cachePath, ec) >= std::filesystem::last_write_time(modelPath, ec)
+        && !ec;
+
+    Ort::SessionOptions options;
+    options.SetIntraOpNumThreads(1);
+    if (envAllocators)
+        options.AddConfigEntry("session.use_env_allocators", "1");
+    if (cached)
+    {
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+    }
+    else
+    {
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+        options.SetOptimizedModelFilePath(cachePath.c_str());
+    }
+    Ort::Session session(env, (cached ? cachePath : modelPath).c_str(), options);
+
+    float ms = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+    std::cout << "Predictor model " << modelPath.filename().string()
+        << (cached ? " (cached optimized graph)" : " (optimized, cache written)")
+        << " loaded in " << ms << " ms" << std::endl;
+    return session;
+}
+
+// Writes the block compressed texture cache of every image below directory
+// that has no up to date one yet, so even the first start of a scene uploads
+// compressed textures. The material libraries found on the way tell which
+// images are normal maps. Returns the number of images that could not be read.
+int bakeTextures(const std::filesystem::path& directory)
+{
+    using clock = std::chrono::high_resolution_clock;
+    auto start = clock::now();
+
+    std::vector<std::string> images;
+    std::unordered_set<std::string> normalMaps;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (it->is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg"
+            || extension == ".tga" || extension == ".bmp" || extension == ".psd" || extension == ".hdr"))
+            images.push_back(it->path().string());
+        else if (it->is_regular_file() && extension == ".mtl")
+            collectNormalMaps(it->path(), normalMaps);
+    }
+    if (ec)
+    {
+        std::cout << "ERROR::TEXTURE_CACHE::" << directory.string() << " cannot be listed: " << ec.message() << std::endl;
+        return -1;
+    }
+
+    std::vector<char> normalMap(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+        normalMap[i] = normalMaps.count(TextureRegistry::normalize(images[i])) != 0;
+
+    std::vector<char> compressed(images.size()), failed(images.size());
+    auto bake = [&](int index)
+    {
+        CompressedImage image;
+        bool wasCompressed;
+        failed[index] = !TextureCache::load(images[index], normalMap[index] != 0, image, wasCompressed);
+        compressed[index] = wasCompressed;
+    };
+    unsigned cores = std::thread::hardware_concurrency();
+    WorkerPool pool(cores > 1 ? cores - 1 : 1);
+    pool.run((int)images.size(), bake);
+
+    int failures = 0;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        if (failed[i])
+        {
+            std::cout << "Texture failed to load at path: " << images[i] << std::endl;
+            ++failures;
+        }
+    }
+    std::cout << "Textures: " << images.size() << " images (" << std::count(normalMap.begin(), normalMap.end(), 1) << " normal maps), "
+        << std::count(compressed.begin(), compressed.end(), 1) << " compressed, " << failures << " failed in " << std::chrono::duration<float, std::milli>(clock::now() - start).count() << " ms" << std::endl;
+    return failures;
+}
+
+// adds the images a material library uses as bump maps, which Assimp's OBJ
+// importer hands to Model as texture_normal, by their TextureRegistry key
+void collectNormalMaps(const std::filesystem::path& library, std::unordered_set<std::string>& normalMaps)
+{
+    std::ifstream file(library);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream tokens(line);
+        std::string keyword, token, name;
+        tokens >> keyword;
+        std::transform(keyword.begin(), keyword.end(), keyword.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (keyword != "bump" && keyword != "map_bump")
+            continue;
+        // options such as -bm come first, the file name last
+        while (tokens >> token)
+            name = token;
+        if (!name.empty())
+            normalMaps.insert(TextureRegistry::normalize((library.parent_path() / name).string()));
+    }
+}
+
+// Checks every row kernel this CPU can run against the scalar reference and
+// times it on full shading rate maps, with the gaze jumping between two points
+// so every frame rewrites the rings. Returns the number of kernels that differ.
+int benchFoveationKernels()
+{
+    using clock = std::chrono::high_resolution_clock;
+    const float thresholdsSq[3] = { 5.0f * 5.0f, 10.0f * 10.0f, 20.0f * 20.0f };
+    // 16 pixel texels at 1080p and 4K, 8 pixel texels at 4K
+    const int sizes[3][2] = { { 120, 68 }, { 240, 135 }, { 480, 270 } };
+
+    int failures = 0;
+    for (const FoveationKernel::Path& path : FoveationKernel::paths())
+    {
+        bool exact = FoveationKernel::verify(path.func);
+        failures += exact ? 0 : 1;
+        std::cout << "Foveation kernel " << path.name << ": " << (exact ? "bit-exact" : "DIFFERS from scalar");
+        for (const auto& size : sizes)
+        {
+            const int width = size[0], height = size[1];
+            // squared eccentricity in degrees for two gaze centers, 0.25 deg per texel
+            std::vector<float> distanceSq[2];
+            for (int c = 0; c < 2; ++c)
             {
-                m_shadingRateImageData[x + y * width] = 2;
+                distanceSq[c].resize((size_t)width * height);
+                float centerX = width * (c ? 0.7f : 0.3f), centerY = height * 0.5f;
+                for (int y = 0; y < height; ++y)
+                    for (int x = 0; x < width; ++x)
+                    {
+                        float dx = (x - centerX) * 0.25f, dy = (y - centerY) * 0.25f;
+                        distanceSq[c][(size_t)y * width + x] = dx * dx + dy * dy;
+                    }
             }
-            else
+            std::vector<uint8_t> map((size_t)width * height, 0);
+
+            const int frames = std::max(20, 20000000 / (width * height));
+            int changed = 0;
+            auto start = clock::now();
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                const std::vector<float>& field = distanceSq[frame & 1];
+                for (int y = 0; y < height; ++y)
+                {
+                    FoveationKernel::RowParams p = { width, field.data() + (size_t)y * width, thresholdsSq, 3, 0 };
+                    int first = width, last = -1;
+                    path.func(map.data() + (size_t)y * width, p, first, last);
+                    changed += last >= first;
+                }
+            }
+            float ns = std::chrono::duration<float, std::nano>(clock::now() - start).count();
+            std::cout << ", " << width << "x" << height << " " << ns / ((float)frames * width * height) << " ns/texel";
+            // keeps the work observable
+            if (changed < 0)
+                std::cout << "?";
+        }
+        std::cout << std::endl;
+    }
+    return failures;
+}
+
+// Runs compareShadingRateUploads in a hidden window of its own. Needs neither
+// the NV extension nor a tracker, so it also runs on Mesa's llvmpipe
+// (LIBGL_ALWAYS_SOFTWARE=1). Returns 1 if the uploads differ.
+int checkShadingRateUploads()
+{
+    if (createHiddenContext(4, 4, "Shading rate upload check") == NULL)
+        return 1;
+    int result = compareShadingRateUploads();
+    glfwTerminate();
+    return result;
+}
+
+// Loads the scene once with its cache removed, so Assimp imports it and
+// writes a new one, then WARM_LOADS times from that cache. Every load
+// includes its textures and ends with a glFinish; the texture caches are
+// left as they are. Returns 1 if a load fails or no cache gets written.
+int benchSceneLoad()
+{
+    using clock = std::chrono::high_resolution_clock;
+    const int WARM_LOADS = 3;
+
+    if (createHiddenContext(4, 6, "Scene load benchmark") == NULL)
+        return 1;
+    // the model goes away before the context, it holds GL objects
+    auto load = [](float& ms) {
+        auto start = clock::now();
+        auto model = std::make_unique<Model>(SCENE_PATH);
+        glFinish();
+        ms = std::chrono::duration<float, std::milli>(clock::now() - start).count();
+        return !model->meshes.empty();
+    };
+
+    const std::string cachePath = SceneCache::cachePath(SCENE_PATH);
+    std::error_code ec;
+    std::filesystem::remove(cachePath, ec);
+    float coldMs = 0.0f;
+    bool loaded = load(coldMs);
+    if (loaded && !std::filesystem::exists(cachePath, ec))
+    {
+        std::cout << "ERROR::SCENE_CACHE::" << cachePath << " was not written" << std::endl;
+        glfwTerminate();
+        return 1;
+    }
+    float warmMs = 0.0f;
+    for (int i = 0; loaded && i < WARM_LOADS; ++i)
+    {
+        float ms = 0.0f;
+        loaded = load(ms);
+        warmMs += ms / WARM_LOADS;
+    }
+    glfwTerminate();
+    if (!loaded)
+    {
+        std::cout << "ERROR::SCENE_CACHE::" << SCENE_PATH << " did not load" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Scene load: cold " << coldMs << " ms (Assimp import, cache written), warm " << warmMs
+        << " ms (scene cache, mean of " << WARM_LOADS << "), " << coldMs / warmMs << "x" << std::endl;
+    return 0;
+}
+
+// hidden window with a current context of at least major.minor core and glad
+// loaded, for the modes that need GL but draw nothing; NULL if there is none
+GLFWwindow* createHiddenContext(int major, int minor, const char* title)
+{
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, title, NULL, NULL);
+    if (window == NULL)
+    {
+        std::cout << "Failed to create an OpenGL " << major << "." << minor << " context" << std::endl;
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return NULL;
+    }
+    return window;
+}
+
+// Feeds the same random dirty regions to a shading rate image streaming
+// through the PBO ring and to one uploading synchronously, then reads both
+// textures back. Some frames wait for the GPU and some do not, so ring slots
+// are reused both free and still in flight. Needs a current context, returns
+// 1 if the textures differ from each other or from the CPU-side texels.
+int compareShadingRateUploads()
+{
+    if (!GLAD_GL_VERSION_4_4)
+    {
+        std::cout << "ERROR::SHADING_RATE_IMAGE::persistent mapping needs OpenGL 4.4" << std::endl;
+        return 1;
+    }
+
+    ShadingRateImage ring;
+    ShadingRateImage sync;
+    ring.init(true);
+    sync.init(false);
+    // not a multiple of the texel size, so the edge texels are partial
+    ring.resize(1000, 700);
+    sync.resize(1000, 700);
+    if (!ring.isStreaming())
+    {
+        std::cout << "ERROR::SHADING_RATE_IMAGE::the PBO ring could not be created" << std::endl;
+        ring.destroy();
+        sync.destroy();
+        return 1;
+    }
+
+    const uint32_t width = ring.width();
+    const uint32_t height = ring.height();
+    const int FRAMES = 64;
+    uint32_t seed = 12345;
+    auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        uint32_t x0 = random() % width, y0 = random() % height;
+        uint32_t x1 = x0 + 1 + random() % (width - x0), y1 = y0 + 1 + random() % (height - y0);
+        uint8_t rate = (uint8_t)random();
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            for (uint32_t x = x0; x < x1; ++x)
             {
-                m_shadingRateImageData[x + y * width] = 3;
+                uint8_t value = (uint8_t)(rate + x * 7 + y * 13);
+                ring.data()[y * width + x] = value;
+                sync.data()[y * width + x] = value;
             }
         }
+        ring.markDirty(x0, y0, x1, y1);
+        sync.markDirty(x0, y0, x1, y1);
+        ring.upload();
+        sync.upload();
+        if (frame % 3 == 0)
+            glFinish();
+        else
+            glFlush();
+    }
+
+    auto readBack = [width, height](const ShadingRateImage& image) {
+        std::vector<uint8_t> texels((size_t)width * height);
+        glBindTexture(GL_TEXTURE_2D, image.texture());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texels;
+    };
+    std::vector<uint8_t> ringTexels = readBack(ring);
+    std::vector<uint8_t> syncTexels = readBack(sync);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < ringTexels.size(); ++i)
+        mismatches += ringTexels[i] != syncTexels[i] || syncTexels[i] != sync.data()[i];
+    std::cout << "Shading rate uploads: " << FRAMES << " frames of " << width << "x" << height << " texels, "
+        << mismatches << " texels differ between the PBO ring and synchronous uploads" << std::endl;
+    ring.destroy();
+    sync.destroy();
+    if (mismatches != 0)
+    {
+        std::cout << "ERROR::SHADING_RATE_IMAGE::the PBO ring uploads differ from the synchronous ones" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+// debug CRT heap allocations of a thread while it counts them, the application
+// side of --bench-predictor; ORT's own heap is not the debug CRT's
+thread_local bool countCrtAllocations = false;
+thread_local uint64_t crtAllocations = 0;
+int countCrtAllocation(int allocType, void*, size_t, int, long, const unsigned char*, int)
+{
+    if (countCrtAllocations && (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC))
+        ++crtAllocations;
+    return 1;
+}
+#endif
+
+// Drives the predictor on this thread instead of its worker, with the gaze
+// source given on the command line, and counts the heap allocations of its
+// iterations once every batch size has run: ORT's through the allocator its
+// session was created with, the application's through the debug CRT in debug
+// builds. Returns 1 if there were any.
+int benchPredictorAllocations(GazePredictor& predictor, const CountingOrtAllocator& ortAllocator)
+{
+    using clock = std::chrono::high_resolution_clock;
+    // every run takes at least one new sample, so this fills the history of the largest batch
+    const uint64_t WARMUP_RUNS = 500;
+    const uint64_t RUNS = 1000;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+    _CRT_ALLOC_HOOK previousHook = _CrtSetAllocHook(countCrtAllocation);
+#endif
+    uint64_t ortAllocations = 0;
+    uint64_t ortRequests = 0;
+    uint64_t appAllocations = 0;
+    float runUs = 0.0f;
+    while (predictor.runs() < WARMUP_RUNS + RUNS)
+    {
+        bool warm = predictor.runs() >= WARMUP_RUNS;
+        bool finished = gazeIngest.finished();
+        uint64_t heapBefore = ortAllocator.heapAllocations();
+        uint64_t requestsBefore = ortAllocator.requests();
+#if defined(_MSC_VER) && defined(_DEBUG)
+        uint64_t crtBefore = crtAllocations;
+        countCrtAllocations = warm;
+#endif
+        auto start = clock::now();
+        bool ran = predictor.step();
+        auto end = clock::now();
+#if defined(_MSC_VER) && defined(_DEBUG)
+        countCrtAllocations = false;
+        appAllocations += crtAllocations - crtBefore;
+#endif
+        if (warm)
+        {
+            ortAllocations += ortAllocator.heapAllocations() - heapBefore;
+            ortRequests += ortAllocator.requests() - requestsBefore;
+        }
+        if (ran && warm)
+            runUs += std::chrono::duration<float, std::micro>(end - start).count();
+        // a finished source that left nothing to run on is out of samples
+        if (!ran && finished)
+            break;
+        if (!ran)
+            std::this_thread::sleep_for(std::chrono::microseconds(250));
+    }
+#if defined(_MSC_VER) && defined(_DEBUG)
+    _CrtSetAllocHook(previousHook);
+#endif
+
+    uint64_t measured = predictor.runs() > WARMUP_RUNS ? predictor.runs() - WARMUP_RUNS : 0;
+    std::cout << "Gaze predictor bench: " << predictor.engineName() << ", " << predictor.batch() << " window(s) per run, "
+        << measured << " warmed runs, " << (measured ? runUs / measured : 0.0f) << " us/run" << std::endl;
+    std::cout << "  ONNX Runtime: " << ortAllocations << " heap allocations for " << ortRequests << " allocator requests" << std::endl;
+#if defined(_MSC_VER) && defined(_DEBUG)
+    std::cout << "  application: " << appAllocations << " heap allocations" << std::endl;
+#else
+    std::cout << "  application: not counted, the debug CRT counts it in debug builds" << std::endl;
+#endif
+    if (measured < RUNS)
+    {
+        std::cout << "ERROR::GAZE_PREDICTOR::the gaze source ran out after " << predictor.runs() << " runs" << std::endl;
+        return 1;
     }
+    if (ortAllocations != 0 || appAllocations != 0)
+    {
+        std::cout << "ERROR::GAZE_PREDICTOR::the steady-state loop allocated" << std::endl;
+        return 1;
+    }
+    return 0;
 }
 
-void uploadFoveationDataToTexture(GLuint texture)
+// Replays a gaze trace through the FP32 and the INT8 predictor, one window per
+// valid sample, and reports each session's run time and how far the INT8
+// prediction lands from the FP32 one. Returns 0 if the trace could be compared.
+int compareInt8Predictor(Ort::Session& fp32, Ort::Session& int8, const std::string& tracePath)
 {
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, m_shadingRateImageWidth, m_shadingRateImageHeight);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_shadingRateImageWidth, m_shadingRateImageHeight, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &m_shadingRateImageData[0]);
+    using clock = std::chrono::high_resolution_clock;
+    const int WINDOW = GazePredictor::WINDOW;
+
+    // the whole trace, in degrees
+    struct Collector : GazeSink
+    {
+        std::vector<std::pair<float, float>> degrees;
+        bool push(const GazeSample& sample) override
+        {
+            if (sample.valid)
+                degrees.push_back(pixelsToDegreesFromNormalized(sample.x, sample.y));
+            return true;
+        }
+    } trace;
+    ReplayGazeSource replay(ReplayGazeSource::AS_FAST_AS_POSSIBLE);
+    if (!replay.open(tracePath))
+        return -1;
+    while (!replay.finished())
+        replay.poll(trace);
+
+    // both models have to predict the same fixed number of values per window
+    std::vector<int64_t> outputShape = fp32.GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (outputShape.empty() || outputShape != int8.GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape())
+    {
+        std::cout << "ERROR::GAZE_PREDICTOR::the FP32 and INT8 models have different outputs" << std::endl;
+        return -1;
+    }
+    outputShape[0] = 1;
+    size_t outputCount = 1;
+    for (int64_t dim : outputShape)
+    {
+        if (dim <= 0)
+        {
+            std::cout << "ERROR::GAZE_PREDICTOR::the model output size is not fixed" << std::endl;
+            return -1;
+        }
+        outputCount *= (size_t)dim;
+    }
+    if (outputCount % 2 != 0)
+    {
+        std::cout << "ERROR::GAZE_PREDICTOR::the model output is not a list of (x, y) points" << std::endl;
+        return -1;
+    }
+    if ((int)trace.degrees.size() < WINDOW)
+    {
+        std::cout << "ERROR::GAZE_PREDICTOR::" << tracePath << " has fewer than " << WINDOW << " valid samples" << std::endl;
+        return -1;
+    }
+
+    std::vector<float> input(WINDOW * 2), fp32Output(outputCount), int8Output(outputCount);
+    const int64_t inputShape[3] = { 1, WINDOW, 2 };
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    Ort::Value inputTensor = Ort::Value::CreateTensor<float>(memoryInfo, input.data(), input.size(), inputShape, 3);
+    Ort::Value fp32Tensor = Ort::Value::CreateTensor<float>(memoryInfo, fp32Output.data(), outputCount, outputShape.data(), outputShape.size());
+    Ort::Value int8Tensor = Ort::Value::CreateTensor<float>(memoryInfo, int8Output.data(), outputCount, outputShape.data(), outputShape.size());
+    const char* inputNames[] = { "input" };
+    const char* outputNames[] = { "output" };
+    Ort::RunOptions runOptions;
+
+    const size_t windows = trace.degrees.size() - WINDOW + 1;
+    std::vector<float> fp32Us, int8Us;
+    fp32Us.reserve(windows);
+    int8Us.reserve(windows);
+    double errorSum = 0.0;
+    float maxError = 0.0f;
+    for (size_t w = 0; w < windows; ++w)
+    {
+        for (int i = 0; i < WINDOW; ++i)
+        {
+            input[2 * i] = trace.degrees[w + i].first;
+            input[2 * i + 1] = trace.degrees[w + i].second;
+        }
+        auto start = clock::now();
+        fp32.Run(runOptions, inputNames, &inputTensor, 1, outputNames, &fp32Tensor, 1);
+        auto middle = clock::now();
+        int8.Run(runOptions, inputNames, &inputTensor, 1, outputNames, &int8Tensor, 1);
+        auto end = clock::now();
+        fp32Us.push_back(std::chrono::duration<float, std::micro>(middle - start).count());
+        int8Us.push_back(std::chrono::duration<float, std::micro>(end - middle).count());
+
+        // every predicted point is an (x, y) gaze angle
+        for (size_t k = 0; k < outputCount; k += 2)
+        {
+            float error = std::hypot(int8Output[k] - fp32Output[k], int8Output[k + 1] - fp32Output[k + 1]);
+            errorSum += error;
+            maxError = std::max(maxError, error);
+        }
+    }
+
+    auto report = [](const char* name, std::vector<float>& us)
+    {
+        double sum = 0.0;
+        for (float t : us)
+            sum += t;
+        std::sort(us.begin(), us.end());
+        std::cout << name << ": mean " << sum / us.size() << " us, p99 " << us[(size_t)(0.99 * (us.size() - 1))] << " us" << std::endl;
+    };
+    std::cout << "Predictor comparison on " << windows << " windows of " << tracePath << std::endl;
+    report("  FP32", fp32Us);
+    report("  INT8", int8Us);
+    std::cout << "  INT8 vs FP32 error: mean " << errorSum / (windows * (outputCount / 2)) << " deg, max " << maxError << " deg" << std::endl;
+    return 0;
 }
 
 bool InitNVShadingRateImageExtensions() {
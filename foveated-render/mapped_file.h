@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are only read in as they
+// are touched, so large files cost address space rather than RAM.
+//
+// The platform code lives in mapped_file.cpp: windows.h defines macros such
+// as near and far that break any translation unit it reaches.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // map path, false if it cannot be opened or is empty
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool isOpen() const { return m_data != nullptr; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    // file and mapping HANDLEs, null when not open
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+#endif
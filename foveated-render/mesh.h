@@ -1,3 +1,6 @@
+#ifndef MESH_H
+#define MESH_H
+
 #include <iostream>
 #include <vector>
 #include "shader.h"
@@ -20,21 +23,29 @@ struct Texture
 class Mesh
 {
 public:
+    // CPU copies, empty for meshes uploaded straight from a mapped scene cache
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
     float shininess;
     unsigned int VAO;
+    unsigned int indexCount = 0;
     glm::vec3 diffuseColor; //
     glm::vec3 specularColor;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, float shininess) : vertices(vertices), indices(indices), textures(textures), shininess(shininess)
+    // the vectors are moved in, pass them with std::move to avoid copying the geometry
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, float shininess) : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), shininess(shininess)
+    {
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    }
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, float shininess, glm::vec3 diffuseColor, glm::vec3 specularColor) : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), shininess(shininess), diffuseColor(diffuseColor), specularColor(specularColor)
     {
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
     }
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, float shininess, glm::vec3 diffuseColor, glm::vec3 specularColor) : vertices(vertices), indices(indices), textures(textures), shininess(shininess), diffuseColor(diffuseColor), specularColor(specularColor)
+    // uploads the geometry straight from the given memory (e.g. a mapped scene cache) and keeps no CPU copy
+    Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount, std::vector<Texture> textures, float shininess, glm::vec3 diffuseColor, glm::vec3 specularColor) : textures(std::move(textures)), shininess(shininess), diffuseColor(diffuseColor), specularColor(specularColor)
     {
-        setupMesh();
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
     }
     void Draw(Shader& shader)
     {
@@ -77,24 +88,31 @@ public:
         glActiveTexture(GL_TEXTURE0);
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
     }
 
 private:
     unsigned int VBO, EBO;
 
-    void setupMesh()
+    // immutable storage, the geometry never changes after the upload; a mesh
+    // without vertices or indices gets no storage and draws nothing
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount)
     {
+        const bool empty = vertexCount == 0 || indexCount == 0;
+        this->indexCount = empty ? 0 : (unsigned int)indexCount;
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        // zero-sized storage is GL_INVALID_VALUE
+        if (!empty)
+            glBufferStorage(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, 0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        if (!empty)
+            glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, 0);
 
         // position attribute
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -114,4 +132,6 @@ private:
 
         glBindVertexArray(0);
     };
-};
\ No newline at end of file
+};
+
+#endif
@@ -4,29 +4,46 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <chrono>
 #include <string>
+#include <thread>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "mesh.h"
+#include "scene_cache.h"
 #include "stb_image.h"
 #include "shader.h"
+#include "texture_loader.h"
+#include "texture_registry.h"
 
-unsigned int TextureFromFile(const char* path, const std::string& directory);
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool normalMap);
 
 class Model
 {
 public:
     std::vector<Mesh> meshes;
     std::string directory;
-    std::vector<Texture> textures_loaded;
+    // this model's textures by material path, the GL textures are shared through TextureRegistry
+    std::unordered_map<std::string, Texture> textures_loaded;
     Model(std::string const& path)
     {
         loadModel(path);
     }
+    ~Model()
+    {
+        for (const auto& loaded : textures_loaded)
+            TextureRegistry::shared().release(directory + '/' + loaded.first);
+    }
+
+    // holds references in the texture registry, pass it by reference
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
     void Draw(Shader& shader)
     {
         for (unsigned int i = 0; i < meshes.size(); i++)
@@ -34,23 +51,83 @@ public:
     }
 
 private:
+    // set while loading, textures are then decoded in the background
+    TextureLoader* textureLoader = nullptr;
+
     void loadModel(std::string const& path)
     {
+        using clock = std::chrono::high_resolution_clock;
+        auto start = clock::now();
 
         std::string sanitizedPath = path;
         std::replace(sanitizedPath.begin(), sanitizedPath.end(), '\\', '/');
+        directory = sanitizedPath.substr(0, sanitizedPath.find_last_of('/'));
+
+        // a scene cache is only used for the same source content and import flags
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+        const std::string cachePath = SceneCache::cachePath(sanitizedPath);
+        uint64_t sourceHash = 0;
+        bool hashed = SceneCache::hashSource(sanitizedPath, sourceHash);
+
+        // every texture is requested before the geometry, so decoding overlaps it;
+        // the main thread keeps the GL work and leaves one core to the system
+        unsigned cores = std::thread::hardware_concurrency();
+        TextureLoader loader(cores > 3 ? cores - 3 : 1);
+        textureLoader = &loader;
+
+        // geometry goes from the mapped cache straight into the GL buffers
+        SceneCacheReader cache;
+        if (hashed && cache.open(cachePath, sourceHash, importFlags))
+        {
+            std::vector<std::vector<Texture>> textures(cache.meshCount());
+            for (uint32_t i = 0; i < cache.meshCount(); ++i)
+            {
+                for (const Texture& texture : cache.textures(i))
+                    textures[i].push_back(loadTexture(texture.path, texture.type));
+            }
+            loader.start();
+
+            meshes.reserve(cache.meshCount());
+            for (uint32_t i = 0; i < cache.meshCount(); ++i)
+            {
+                const SceneCache::MeshRecord& record = cache.mesh(i);
+                meshes.emplace_back(cache.vertices(i), record.vertexCount, cache.indices(i), record.indexCount, std::move(textures[i]), record.shininess,
+                    glm::vec3(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]),
+                    glm::vec3(record.specularColor[0], record.specularColor[1], record.specularColor[2]));
+                loader.uploadReady();
+            }
+            loader.finish();
+            textureLoader = nullptr;
+            std::cout << "Model " << sanitizedPath << ": " << meshes.size() << " meshes from the scene cache in "
+                << std::chrono::duration<float, std::milli>(clock::now() - start).count() << " ms" << std::endl;
+            return;
+        }
 
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(sanitizedPath, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(sanitizedPath, importFlags);
 
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+            textureLoader = nullptr;
             return;
         }
-        directory = sanitizedPath.substr(0, sanitizedPath.find_last_of('/'));
 
+        requestTextures(scene->mRootNode, scene);
+        loader.start();
         processNode(scene->mRootNode, scene);
+        bool written = hashed && SceneCache::write(cachePath, sourceHash, importFlags, meshes);
+        loader.finish();
+        textureLoader = nullptr;
+        // the GL buffers hold the geometry now
+        for (Mesh& mesh : meshes)
+        {
+            std::vector<Vertex>().swap(mesh.vertices);
+            std::vector<unsigned int>().swap(mesh.indices);
+        }
+        std::cout << "Model " << sanitizedPath << ": " << meshes.size() << " meshes imported in "
+            << std::chrono::duration<float, std::milli>(clock::now() - start).count() << " ms"
+            << (written ? ", scene cache written" : "") << std::endl;
     }
     void processNode(aiNode* node, const aiScene* scene)
     {
@@ -59,6 +136,8 @@ private:
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 
             meshes.push_back(processMesh(mesh, scene));
+            if (textureLoader)
+                textureLoader->uploadReady();
         }
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
@@ -66,11 +145,28 @@ private:
         }
     }
 
+    // same traversal and texture order as processNode, so processMesh later finds every texture loaded
+    void requestTextures(aiNode* node, const aiScene* scene)
+    {
+        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            aiMaterial* material = scene->mMaterials[scene->mMeshes[node->mMeshes[i]]->mMaterialIndex];
+            loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+            loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+            loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+            loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        }
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            requestTextures(node->mChildren[i], scene);
+    }
+
     Mesh processMesh(aiMesh* mesh, const aiScene* scene)
     {
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         glm::vec3 diffuseColor(1.0f, 1.0f, 1.0f);  // default fallback diffuse
         glm::vec3 specularColor(1.0f, 1.0f, 1.0f); // default fallback specular
@@ -163,7 +259,7 @@ private:
             }
         }
 
-        return Mesh(vertices, indices, textures, shininess, diffuseColor, specularColor);
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), shininess, diffuseColor, specularColor);
     }
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
     {
@@ -172,32 +268,34 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(),
-                    str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true;
-                    break;
-                }
-            }
-            if (!skip)
-            {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+    // a texture path already loaded by this model is reused as it is, one loaded
+    // by another model shares its GL texture
+    Texture loadTexture(const std::string& path, const std::string& typeName)
+    {
+        auto loaded = textures_loaded.find(path);
+        if (loaded != textures_loaded.end())
+            return loaded->second;
+
+        const std::string filename = directory + '/' + path;
+        // normal maps are block compressed differently from colour
+        const bool normalMap = typeName == "texture_normal";
+        Texture texture;
+        texture.id = TextureRegistry::shared().acquire(filename, [&]
+        {
+            return textureLoader ? textureLoader->request(filename, normalMap) : TextureFromFile(path.c_str(), directory, normalMap);
+        });
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.emplace(path, texture);
+        return texture;
+    }
 };
 
-unsigned int TextureFromFile(const char* path, const std::string& directory)
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool normalMap)
 {
     std::string filename = std::string(path);
     filename =  directory + '/' + filename;
@@ -205,34 +303,13 @@ unsigned int TextureFromFile(const char* path, const std::string& directory)
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
+    // block compressed with its mip chain, from the texture cache or compressed into it now
+    CompressedImage image;
+    bool compressed;
+    if (TextureCache::load(filename, normalMap, image, compressed))
+        uploadCompressedImage(textureID, image);
     else
-    {
         std::cout << "Texture failed to load at path: " << filename << std::endl;
-        stbi_image_free(data);
-    }
 
     return textureID;
 }
\ No newline at end of file
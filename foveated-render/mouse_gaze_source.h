@@ -0,0 +1,58 @@
+#ifndef MOUSE_GAZE_SOURCE_H
+#define MOUSE_GAZE_SOURCE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "gaze_source.h"
+
+// Gaze that follows the mouse cursor. setPosition() is called from the GLFW
+// cursor callback on the main thread; poll() samples the latest position at a
+// fixed rate on the ingest thread, so consumers see a tracker-like stream.
+class MouseGazeSource : public GazeSource
+{
+public:
+    explicit MouseGazeSource(float sampleRateHz = 1000.0f)
+        : m_period(std::chrono::microseconds((int64_t)(1e6f / sampleRateHz)))
+    {
+    }
+
+    // cursor position in [0, 1], origin at the bottom left
+    void setPosition(float x, float y)
+    {
+        m_x.store(x, std::memory_order_relaxed);
+        m_y.store(y, std::memory_order_relaxed);
+    }
+
+    void poll(GazeSink& sink) override
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!m_started)
+        {
+            m_next = now;
+            m_started = true;
+        }
+
+        GazeSample sample;
+        sample.x = m_x.load(std::memory_order_relaxed) * 2.0f - 1.0f;
+        sample.y = m_y.load(std::memory_order_relaxed) * 2.0f - 1.0f;
+        sample.valid = true;
+        for (; m_next <= now; m_next += m_period)
+        {
+            sample.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(m_next.time_since_epoch()).count();
+            sink.push(sample);
+        }
+    }
+
+    const char* name() const override { return "mouse"; }
+
+private:
+    std::chrono::steady_clock::duration m_period;
+    std::atomic<float> m_x{ 0.5f };
+    std::atomic<float> m_y{ 0.5f };
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_next;
+};
+
+#endif
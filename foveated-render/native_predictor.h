@@ -0,0 +1,909 @@
+#ifndef NATIVE_PREDICTOR_H
+#define NATIVE_PREDICTOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#include <emmintrin.h>
+#define NATIVE_PREDICTOR_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NATIVE_PREDICTOR_NEON
+#endif
+
+#include "onnx_model.h"
+
+// In-process interpreter for the small MLP/GRU graphs the gaze predictor is
+// exported as, a fast path around ONNX Runtime's per-call overhead.
+//
+// The weights and graph come from the same .onnx file the ORT session loads.
+// Supported operators: Gemm, MatMul with a constant right-hand side, GRU
+// (forward, default activations), the elementwise Add/Sub/Mul/Div, Relu,
+// LeakyRelu, Tanh, Sigmoid, and the shape plumbing PyTorch exports around
+// them (Shape, Gather, Slice, Concat, Reshape, Flatten, Squeeze, Unsqueeze,
+// Transpose, Cast, Constant, ConstantOfShape, Identity, Dropout). load()
+// refuses any other graph, so callers can fall back to ORT.
+//
+// Weight matrices are stored with one row per output unit, so every layer is
+// a sequence of contiguous dot products, vectorized with SSE2/NEON. Value
+// buffers keep their capacity between runs and the shape plumbing works in
+// scratch vectors reserved by load(), so once the largest batch has run once,
+// run() does not allocate.
+class NativePredictor
+{
+public:
+    bool load(const std::string& path)
+    {
+        OnnxModel model;
+        if (!model.load(path))
+            return false;
+        if (model.inputs.size() != 1 || model.outputs.size() != 1)
+            return fail("the graph must have exactly one input and one output");
+
+        m_values.clear();
+        m_steps.clear();
+        m_names.clear();
+        for (auto& initializer : model.initializers)
+        {
+            Value& value = m_values[valueIndex(initializer.first)];
+            value.constant = true;
+            setTensor(value, initializer.second);
+        }
+        m_input = valueIndex(model.inputs[0]);
+
+        for (const OnnxNode& node : model.nodes)
+        {
+            if (!compile(node, model.opsetVersion))
+                return false;
+        }
+        m_output = valueIndex(model.outputs[0]);
+        // shapes never exceed the rank limit of the strided helpers
+        m_dims.reserve(MAX_RANK);
+        m_axes.reserve(MAX_RANK);
+        return true;
+    }
+
+    // run the graph on a float input of the given shape and copy its outputSize
+    // results to output, false if the graph produces any other number
+    bool run(const float* input, const int64_t* shape, size_t rank, float* output, size_t outputSize)
+    {
+        Value& in = m_values[m_input];
+        in.isInt = false;
+        in.shape.assign(shape, shape + rank);
+        in.f.resize(count(in.shape));
+        std::copy(input, input + in.f.size(), in.f.begin());
+
+        for (const Step& step : m_steps)
+        {
+            if (!execute(step))
+                return false;
+        }
+
+        const Value& out = m_values[m_output];
+        if (out.isInt || out.f.size() != outputSize)
+            return false;
+        std::copy(out.f.begin(), out.f.end(), output);
+        return true;
+    }
+
+private:
+    static const size_t MAX_RANK = 8;
+
+    struct Value
+    {
+        std::vector<int64_t> shape;
+        std::vector<float> f;
+        std::vector<int64_t> i;
+        bool isInt = false;
+        bool constant = false;
+    };
+
+    enum Op
+    {
+        GEMM, MATMUL, GRU,
+        ADD, SUB, MUL, DIV,
+        RELU, LEAKY_RELU, TANH, SIGMOID, IDENTITY,
+        SHAPE, GATHER, SLICE, CONCAT, RESHAPE, FLATTEN, SQUEEZE, UNSQUEEZE, TRANSPOSE, CAST, CONSTANT_OF_SHAPE
+    };
+
+    struct Step
+    {
+        Op op;
+        std::vector<int> inputs;   // -1 for omitted optional inputs
+        std::vector<int> outputs;  // -1 for unused optional outputs
+        int64_t axis = 0;
+        float alpha = 1.0f;
+        float beta = 1.0f;
+        bool flag = false;          // Gemm transB folded in, GRU linear_before_reset, Cast to int
+        std::vector<int64_t> ints;  // Transpose perm, Squeeze/Unsqueeze axes from attributes
+        std::vector<float> weights; // Gemm/MatMul B as [N][K]
+        int64_t rows = 0, cols = 0; // N and K of weights, GRU hidden size in rows
+    };
+
+    std::map<std::string, int> m_names;
+    std::vector<Value> m_values;
+    std::vector<Step> m_steps;
+    int m_input = -1;
+    int m_output = -1;
+
+    static bool fail(const std::string& reason)
+    {
+        std::cout << "Native predictor: " << reason << std::endl;
+        return false;
+    }
+
+    static size_t count(const std::vector<int64_t>& shape)
+    {
+        size_t n = 1;
+        for (int64_t dim : shape)
+            n *= (size_t)dim;
+        return n;
+    }
+
+    int valueIndex(const std::string& name)
+    {
+        if (name.empty())
+            return -1;
+        auto it = m_names.find(name);
+        if (it != m_names.end())
+            return it->second;
+        m_values.emplace_back();
+        m_names[name] = (int)m_values.size() - 1;
+        return (int)m_values.size() - 1;
+    }
+
+    static void setTensor(Value& value, const OnnxTensor& tensor)
+    {
+        value.shape = tensor.dims;
+        value.isInt = tensor.isInt;
+        value.f = tensor.floats;
+        value.i = tensor.ints;
+    }
+
+    const Value* constantInput(const Step& step, size_t index) const
+    {
+        if (index >= step.inputs.size() || step.inputs[index] < 0)
+            return nullptr;
+        const Value& value = m_values[step.inputs[index]];
+        return value.constant ? &value : nullptr;
+    }
+
+    // ------------------------------------------------------------------------
+    bool compile(const OnnxNode& node, int64_t opset)
+    {
+        static const std::map<std::string, Op> ops = {
+            { "Gemm", GEMM }, { "MatMul", MATMUL }, { "GRU", GRU },
+            { "Add", ADD }, { "Sub", SUB }, { "Mul", MUL }, { "Div", DIV },
+            { "Relu", RELU }, { "LeakyRelu", LEAKY_RELU }, { "Tanh", TANH }, { "Sigmoid", SIGMOID },
+            { "Identity", IDENTITY }, { "Dropout", IDENTITY },
+            { "Shape", SHAPE }, { "Gather", GATHER }, { "Slice", SLICE }, { "Concat", CONCAT },
+            { "Reshape", RESHAPE }, { "Flatten", FLATTEN }, { "Squeeze", SQUEEZE }, { "Unsqueeze", UNSQUEEZE },
+            { "Transpose", TRANSPOSE }, { "Cast", CAST }, { "ConstantOfShape", CONSTANT_OF_SHAPE } };
+
+        if (node.opType == "Constant")
+        {
+            auto it = node.attributes.find("value");
+            if (it == node.attributes.end() || node.outputs.empty())
+                return fail("Constant without a tensor value");
+            Value& value = m_values[valueIndex(node.outputs[0])];
+            value.constant = true;
+            setTensor(value, it->second.t);
+            return true;
+        }
+
+        auto op = ops.find(node.opType);
+        if (op == ops.end())
+            return fail("unsupported operator " + node.opType);
+
+        Step step;
+        step.op = op->second;
+        for (const std::string& name : node.inputs)
+            step.inputs.push_back(valueIndex(name));
+        for (const std::string& name : node.outputs)
+            step.outputs.push_back(valueIndex(name));
+        // GRU may only use Y_h, every other operator needs its first output
+        if (step.outputs.empty() || (step.outputs[0] < 0 && step.op != GRU))
+            return fail(node.opType + " without an output");
+
+        switch (step.op)
+        {
+        case GEMM:
+        {
+            const Value* b = constantInput(step, 1);
+            if (node.intAttribute("transA", 0) || !b || b->isInt || b->shape.size() != 2)
+                return fail("Gemm needs a constant 2D B and no transA");
+            step.alpha = node.floatAttribute("alpha", 1.0f);
+            step.beta = node.floatAttribute("beta", 1.0f);
+            packWeights(step, *b, node.intAttribute("transB", 0) != 0);
+            break;
+        }
+        case MATMUL:
+        {
+            const Value* b = constantInput(step, 1);
+            if (!b || b->isInt || b->shape.size() != 2)
+                return fail("MatMul needs a constant 2D right-hand side");
+            packWeights(step, *b, false);
+            break;
+        }
+        case GRU:
+        {
+            auto direction = node.attributes.find("direction");
+            if ((direction != node.attributes.end() && direction->second.s != "forward")
+                || node.has("activations") || node.has("clip") || node.intAttribute("layout", 0) != 0)
+                return fail("only forward GRUs with default activations are supported");
+            if (step.inputs.size() > 4 && step.inputs[4] >= 0)
+                return fail("GRU sequence_lens is not supported");
+            step.rows = node.intAttribute("hidden_size", 0);
+            step.flag = node.intAttribute("linear_before_reset", 0) != 0;
+            for (size_t i = 1; i < std::min<size_t>(step.inputs.size(), 4); ++i)
+            {
+                if (step.inputs[i] >= 0 && !constantInput(step, i))
+                    return fail("GRU weights must be constant");
+            }
+            if (step.rows <= 0 || !constantInput(step, 1) || !constantInput(step, 2))
+                return fail("GRU needs hidden_size, W and R");
+            break;
+        }
+        case LEAKY_RELU:
+            step.alpha = node.floatAttribute("alpha", 0.01f);
+            break;
+        case GATHER:
+        case CONCAT:
+            step.axis = node.intAttribute("axis", 0);
+            break;
+        case FLATTEN:
+            step.axis = node.intAttribute("axis", 1);
+            break;
+        case TRANSPOSE:
+            step.ints = node.has("perm") ? node.attributes.at("perm").ints : std::vector<int64_t>();
+            break;
+        case SQUEEZE:
+        case UNSQUEEZE:
+            // opset 13 moved axes to an input
+            if (node.has("axes"))
+                step.ints = node.attributes.at("axes").ints;
+            break;
+        case SLICE:
+            if (opset < 10)
+                return fail("Slice before opset 10 is not supported");
+            break;
+        case CAST:
+        {
+            int64_t to = node.intAttribute("to", 1);
+            if (to != 1 && to != 6 && to != 7)
+                return fail("Cast only to float, int32 or int64");
+            step.flag = to != 1;
+            break;
+        }
+        case CONSTANT_OF_SHAPE:
+            step.alpha = 0.0f;
+            step.flag = false;
+            if (node.has("value"))
+            {
+                const OnnxTensor& value = node.attributes.at("value").t;
+                step.flag = value.isInt;
+                step.alpha = value.isInt ? (value.ints.empty() ? 0.0f : (float)value.ints[0])
+                    : (value.floats.empty() ? 0.0f : value.floats[0]);
+            }
+            break;
+        default:
+            break;
+        }
+        m_steps.push_back(std::move(step));
+        return true;
+    }
+
+    // store B so that output unit n reads row n: [N][K]
+    static void packWeights(Step& step, const Value& b, bool transposed)
+    {
+        int64_t k = transposed ? b.shape[1] : b.shape[0];
+        int64_t n = transposed ? b.shape[0] : b.shape[1];
+        step.rows = n;
+        step.cols = k;
+        step.weights.resize((size_t)(n * k));
+        for (int64_t row = 0; row < n; ++row)
+        {
+            for (int64_t col = 0; col < k; ++col)
+                step.weights[(size_t)(row * k + col)] = transposed ? b.f[(size_t)(row * k + col)] : b.f[(size_t)(col * n + row)];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    static float dot(const float* a, const float* b, int64_t n)
+    {
+        int64_t i = 0;
+        float sum = 0.0f;
+#if defined(NATIVE_PREDICTOR_SSE2)
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        for (; i + 8 <= n; i += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        __m128 acc = _mm_add_ps(acc0, acc1);
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        sum = _mm_cvtss_f32(acc);
+#elif defined(NATIVE_PREDICTOR_NEON)
+        float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+        for (; i + 8 <= n; i += 8)
+        {
+            acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+            acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+        float32x4_t acc = vaddq_f32(acc0, acc1);
+        float32x2_t half = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+        sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+        for (; i < n; ++i)
+            sum += a[i] * b[i];
+        return sum;
+    }
+
+    static float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+
+    bool execute(const Step& step)
+    {
+        if (step.op == GRU)
+            return gru(step);
+
+        Value& out = m_values[step.outputs[0]];
+        auto in = [&](size_t index) -> Value& { return m_values[step.inputs[index]]; };
+
+        switch (step.op)
+        {
+        case GEMM:
+        case MATMUL:
+        {
+            const Value& a = in(0);
+            if (a.isInt || a.shape.empty() || a.shape.back() != step.cols)
+                return false;
+            size_t m = count(a.shape) / (size_t)step.cols;
+            out.isInt = false;
+            out.shape = a.shape;
+            out.shape.back() = step.rows;
+            out.f.resize(m * (size_t)step.rows);
+            for (size_t row = 0; row < m; ++row)
+            {
+                const float* x = a.f.data() + row * step.cols;
+                float* y = out.f.data() + row * step.rows;
+                for (int64_t n = 0; n < step.rows; ++n)
+                    y[n] = dot(x, step.weights.data() + n * step.cols, step.cols);
+            }
+            if (step.op == GEMM)
+            {
+                for (float& y : out.f)
+                    y *= step.alpha;
+                if (step.inputs.size() > 2 && step.inputs[2] >= 0)
+                {
+                    const Value& c = in(2);
+                    size_t n = (size_t)step.rows;
+                    size_t cCount = c.f.size();
+                    for (size_t row = 0; row < m; ++row)
+                    {
+                        for (size_t col = 0; col < n; ++col)
+                        {
+                            // C is a scalar, a row [N] or [1, N], or a full [M, N]
+                            float cValue = cCount == 1 ? c.f[0] : cCount == n ? c.f[col] : c.f[row * n + col];
+                            out.f[row * n + col] += step.beta * cValue;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+        case GRU:
+            return false;
+        case ADD: return binary(in(0), in(1), out, [](float a, float b) { return a + b; });
+        case SUB: return binary(in(0), in(1), out, [](float a, float b) { return a - b; });
+        case MUL: return binary(in(0), in(1), out, [](float a, float b) { return a * b; });
+        case DIV: return binary(in(0), in(1), out, [](float a, float b) { return a / b; });
+        case RELU: return unary(in(0), out, [](float x, float) { return x > 0.0f ? x : 0.0f; }, 0.0f);
+        case LEAKY_RELU: return unary(in(0), out, [](float x, float alpha) { return x > 0.0f ? x : alpha * x; }, step.alpha);
+        case TANH: return unary(in(0), out, [](float x, float) { return std::tanh(x); }, 0.0f);
+        case SIGMOID: return unary(in(0), out, [](float x, float) { return sigmoid(x); }, 0.0f);
+        case IDENTITY:
+            copyValue(in(0), out);
+            return true;
+        case SHAPE:
+            out.isInt = true;
+            out.i = in(0).shape;
+            out.shape.assign(1, (int64_t)in(0).shape.size());
+            return true;
+        case CAST:
+        {
+            const Value& a = in(0);
+            if (step.flag && !a.isInt)
+            {
+                out.i.resize(a.f.size());
+                for (size_t k = 0; k < a.f.size(); ++k)
+                    out.i[k] = (int64_t)a.f[k];
+            }
+            else if (!step.flag && a.isInt)
+            {
+                out.f.resize(a.i.size());
+                for (size_t k = 0; k < a.i.size(); ++k)
+                    out.f[k] = (float)a.i[k];
+            }
+            else
+            {
+                copyValue(a, out);
+            }
+            out.isInt = step.flag;
+            out.shape = a.shape;
+            return true;
+        }
+        case CONSTANT_OF_SHAPE:
+        {
+            const Value& shape = in(0);
+            out.shape = shape.i;
+            out.isInt = step.flag;
+            if (out.isInt)
+                out.i.assign(count(out.shape), (int64_t)step.alpha);
+            else
+                out.f.assign(count(out.shape), step.alpha);
+            return true;
+        }
+        case RESHAPE:
+        {
+            const Value& a = in(0);
+            const Value& shape = in(1);
+            if (!shape.isInt || shape.i.size() > MAX_RANK)
+                return false;
+            std::vector<int64_t>& dims = m_dims;
+            dims.assign(shape.i.begin(), shape.i.end());
+            int64_t known = 1;
+            int inferred = -1;
+            for (size_t k = 0; k < dims.size(); ++k)
+            {
+                if (dims[k] == 0 && k < a.shape.size())
+                    dims[k] = a.shape[k];
+                if (dims[k] == -1)
+                    inferred = (int)k;
+                else
+                    known *= dims[k];
+            }
+            if (inferred >= 0)
+                dims[inferred] = known ? (int64_t)count(a.shape) / known : 0;
+            copyValue(a, out);
+            out.shape = dims;
+            return count(out.shape) == count(a.shape);
+        }
+        case FLATTEN:
+        {
+            const Value& a = in(0);
+            int64_t axis = step.axis < 0 ? step.axis + (int64_t)a.shape.size() : step.axis;
+            int64_t outer = 1;
+            for (int64_t k = 0; k < axis; ++k)
+                outer *= a.shape[(size_t)k];
+            copyValue(a, out);
+            out.shape = { outer, outer ? (int64_t)count(a.shape) / outer : 0 };
+            return true;
+        }
+        case SQUEEZE:
+        case UNSQUEEZE:
+        {
+            const Value& a = in(0);
+            const std::vector<int64_t>& axesFrom = step.inputs.size() > 1 && step.inputs[1] >= 0 ? in(1).i : step.ints;
+            if (a.shape.size() > MAX_RANK || (step.op == UNSQUEEZE && a.shape.size() + axesFrom.size() > MAX_RANK)
+                || axesFrom.size() > MAX_RANK)
+                return false;
+            std::vector<int64_t>& axes = m_axes;
+            axes.assign(axesFrom.begin(), axesFrom.end());
+            std::vector<int64_t>& shape = m_dims;
+            shape.assign(a.shape.begin(), a.shape.end());
+            if (step.op == SQUEEZE)
+            {
+                if (axes.empty())
+                {
+                    shape.erase(std::remove(shape.begin(), shape.end(), (int64_t)1), shape.end());
+                }
+                else
+                {
+                    for (int64_t& axis : axes)
+                        axis = axis < 0 ? axis + (int64_t)shape.size() : axis;
+                    std::sort(axes.rbegin(), axes.rend());
+                    for (int64_t axis : axes)
+                        shape.erase(shape.begin() + axis);
+                }
+            }
+            else
+            {
+                int64_t rank = (int64_t)shape.size() + (int64_t)axes.size();
+                for (int64_t& axis : axes)
+                    axis = axis < 0 ? axis + rank : axis;
+                std::sort(axes.begin(), axes.end());
+                for (int64_t axis : axes)
+                    shape.insert(shape.begin() + axis, 1);
+            }
+            copyValue(a, out);
+            out.shape = shape;
+            return true;
+        }
+        case TRANSPOSE:
+            return transpose(in(0), out, step.ints);
+        case GATHER:
+            return gather(in(0), in(1), out, step.axis);
+        case SLICE:
+            return slice(step, out);
+        case CONCAT:
+            return concat(step, out);
+        }
+        return false;
+    }
+
+    static void copyValue(const Value& from, Value& to)
+    {
+        if (&from == &to)
+            return;
+        to.isInt = from.isInt;
+        to.shape = from.shape;
+        if (from.isInt)
+            to.i = from.i;
+        else
+            to.f = from.f;
+    }
+
+    template <typename F>
+    static bool unary(const Value& a, Value& out, F f, float parameter)
+    {
+        if (a.isInt)
+            return false;
+        out.isInt = false;
+        out.shape = a.shape;
+        out.f.resize(a.f.size());
+        for (size_t k = 0; k < a.f.size(); ++k)
+            out.f[k] = f(a.f[k], parameter);
+        return true;
+    }
+
+    // numpy-style broadcasting, integers only for shape arithmetic
+    template <typename F>
+    static bool binary(const Value& a, const Value& b, Value& out, F f)
+    {
+        size_t rank = std::max(a.shape.size(), b.shape.size());
+        int64_t shape[8], strideA[8], strideB[8];
+        if (rank > 8)
+            return false;
+        for (size_t k = 0; k < rank; ++k)
+        {
+            int64_t dimA = k + a.shape.size() >= rank ? a.shape[k + a.shape.size() - rank] : 1;
+            int64_t dimB = k + b.shape.size() >= rank ? b.shape[k + b.shape.size() - rank] : 1;
+            if (dimA != dimB && dimA != 1 && dimB != 1)
+                return false;
+            shape[k] = std::max(dimA, dimB);
+            strideA[k] = dimA == 1 ? 0 : 1;
+            strideB[k] = dimB == 1 ? 0 : 1;
+        }
+        // turn the broadcast flags into element strides
+        int64_t runA = 1, runB = 1;
+        for (size_t k = rank; k-- > 0;)
+        {
+            int64_t dimA = k + a.shape.size() >= rank ? a.shape[k + a.shape.size() - rank] : 1;
+            int64_t dimB = k + b.shape.size() >= rank ? b.shape[k + b.shape.size() - rank] : 1;
+            strideA[k] *= runA;
+            strideB[k] *= runB;
+            runA *= dimA;
+            runB *= dimB;
+        }
+
+        bool isInt = a.isInt && b.isInt;
+        out.shape.assign(shape, shape + rank);
+        size_t total = count(out.shape);
+        if (isInt)
+            out.i.resize(total);
+        else
+            out.f.resize(total);
+
+        int64_t index[8] = {};
+        for (size_t n = 0; n < total; ++n)
+        {
+            int64_t offsetA = 0, offsetB = 0;
+            for (size_t k = 0; k < rank; ++k)
+            {
+                offsetA += index[k] * strideA[k];
+                offsetB += index[k] * strideB[k];
+            }
+            float va = a.isInt ? (float)a.i[(size_t)offsetA] : a.f[(size_t)offsetA];
+            float vb = b.isInt ? (float)b.i[(size_t)offsetB] : b.f[(size_t)offsetB];
+            if (isInt)
+                out.i[n] = (int64_t)f(va, vb);
+            else
+                out.f[n] = f(va, vb);
+            for (size_t k = rank; k-- > 0;)
+            {
+                if (++index[k] < shape[k])
+                    break;
+                index[k] = 0;
+            }
+        }
+        out.isInt = isInt;
+        return true;
+    }
+
+    // visit every element of a strided view of shape, calling f(outputIndex, sourceOffset)
+    template <typename F>
+    static void forEach(const std::vector<int64_t>& shape, const int64_t* strides, int64_t base, F f)
+    {
+        size_t rank = shape.size();
+        size_t total = count(shape);
+        int64_t index[8] = {};
+        for (size_t n = 0; n < total; ++n)
+        {
+            int64_t offset = base;
+            for (size_t k = 0; k < rank; ++k)
+                offset += index[k] * strides[k];
+            f(n, offset);
+            for (size_t k = rank; k-- > 0;)
+            {
+                if (++index[k] < shape[k])
+                    break;
+                index[k] = 0;
+            }
+        }
+    }
+
+    static void stridesOf(const std::vector<int64_t>& shape, int64_t* strides)
+    {
+        int64_t run = 1;
+        for (size_t k = shape.size(); k-- > 0;)
+        {
+            strides[k] = run;
+            run *= shape[k];
+        }
+    }
+
+    static void copyElements(const Value& from, Value& to, size_t n, int64_t offset)
+    {
+        if (from.isInt)
+            to.i[n] = from.i[(size_t)offset];
+        else
+            to.f[n] = from.f[(size_t)offset];
+    }
+
+    static void resizeLike(const Value& from, Value& to)
+    {
+        to.isInt = from.isInt;
+        if (from.isInt)
+            to.i.resize(count(to.shape));
+        else
+            to.f.resize(count(to.shape));
+    }
+
+    static bool transpose(const Value& a, Value& out, const std::vector<int64_t>& perm)
+    {
+        size_t rank = a.shape.size();
+        if (rank > MAX_RANK || &a == &out || (!perm.empty() && perm.size() != rank))
+            return false;
+        int64_t strides[MAX_RANK], permuted[MAX_RANK];
+        stridesOf(a.shape, strides);
+        out.shape.resize(rank);
+        for (size_t k = 0; k < rank; ++k)
+        {
+            // no perm reverses the dimensions
+            size_t from = perm.empty() ? rank - 1 - k : (size_t)perm[k];
+            out.shape[k] = a.shape[from];
+            permuted[k] = strides[from];
+        }
+        resizeLike(a, out);
+        forEach(out.shape, permuted, 0, [&](size_t n, int64_t offset) { copyElements(a, out, n, offset); });
+        return true;
+    }
+
+    static bool gather(const Value& data, const Value& indices, Value& out, int64_t axis)
+    {
+        size_t rank = data.shape.size();
+        if (!indices.isInt || &data == &out)
+            return false;
+        axis = axis < 0 ? axis + (int64_t)rank : axis;
+
+        int64_t outer = 1, inner = 1;
+        for (int64_t k = 0; k < axis; ++k)
+            outer *= data.shape[(size_t)k];
+        for (size_t k = (size_t)axis + 1; k < rank; ++k)
+            inner *= data.shape[k];
+        int64_t dim = data.shape[(size_t)axis];
+
+        out.shape.assign(data.shape.begin(), data.shape.begin() + axis);
+        out.shape.insert(out.shape.end(), indices.shape.begin(), indices.shape.end());
+        out.shape.insert(out.shape.end(), data.shape.begin() + axis + 1, data.shape.end());
+        resizeLike(data, out);
+
+        size_t n = 0;
+        for (int64_t o = 0; o < outer; ++o)
+        {
+            for (int64_t index : indices.i)
+            {
+                index = index < 0 ? index + dim : index;
+                for (int64_t k = 0; k < inner; ++k)
+                    copyElements(data, out, n++, (o * dim + index) * inner + k);
+            }
+        }
+        return true;
+    }
+
+    bool slice(const Step& step, Value& out)
+    {
+        const Value& data = m_values[step.inputs[0]];
+        size_t rank = data.shape.size();
+        if (rank > 8 || step.inputs.size() < 3 || &data == &out)
+            return false;
+        const std::vector<int64_t>& starts = m_values[step.inputs[1]].i;
+        const std::vector<int64_t>& ends = m_values[step.inputs[2]].i;
+        const std::vector<int64_t>* axes = step.inputs.size() > 3 && step.inputs[3] >= 0 ? &m_values[step.inputs[3]].i : nullptr;
+        const std::vector<int64_t>* steps = step.inputs.size() > 4 && step.inputs[4] >= 0 ? &m_values[step.inputs[4]].i : nullptr;
+
+        int64_t strides[8], begin[8], stepOf[8];
+        stridesOf(data.shape, strides);
+        out.shape = data.shape;
+        for (size_t k = 0; k < rank; ++k)
+        {
+            begin[k] = 0;
+            stepOf[k] = 1;
+        }
+        for (size_t k = 0; k < starts.size(); ++k)
+        {
+            int64_t axis = !axes || axes->empty() ? (int64_t)k : (*axes)[k];
+            axis = axis < 0 ? axis + (int64_t)rank : axis;
+            int64_t dim = data.shape[(size_t)axis];
+            int64_t stride = !steps || steps->empty() ? 1 : (*steps)[k];
+            if (stride == 0)
+                return false;
+            int64_t start = starts[k] < 0 ? starts[k] + dim : starts[k];
+            int64_t end = ends[k] < 0 ? ends[k] + dim : ends[k];
+            if (stride > 0)
+            {
+                start = std::clamp<int64_t>(start, 0, dim);
+                end = std::clamp<int64_t>(end, 0, dim);
+                out.shape[(size_t)axis] = std::max<int64_t>(0, (end - start + stride - 1) / stride);
+            }
+            else
+            {
+                start = std::clamp<int64_t>(start, -1, dim - 1);
+                end = std::clamp<int64_t>(end, -1, dim - 1);
+                out.shape[(size_t)axis] = std::max<int64_t>(0, (start - end - stride - 1) / -stride);
+            }
+            begin[(size_t)axis] = start;
+            stepOf[(size_t)axis] = stride;
+        }
+
+        int64_t base = 0, viewStrides[8];
+        for (size_t k = 0; k < rank; ++k)
+        {
+            base += begin[k] * strides[k];
+            viewStrides[k] = stepOf[k] * strides[k];
+        }
+        resizeLike(data, out);
+        forEach(out.shape, viewStrides, base, [&](size_t n, int64_t offset) { copyElements(data, out, n, offset); });
+        return true;
+    }
+
+    bool concat(const Step& step, Value& out)
+    {
+        const Value& first = m_values[step.inputs[0]];
+        size_t rank = first.shape.size();
+        int64_t axis = step.axis < 0 ? step.axis + (int64_t)rank : step.axis;
+
+        int64_t outer = 1, inner = 1, total = 0;
+        for (int64_t k = 0; k < axis; ++k)
+            outer *= first.shape[(size_t)k];
+        for (size_t k = (size_t)axis + 1; k < rank; ++k)
+            inner *= first.shape[k];
+        for (int index : step.inputs)
+        {
+            if (&m_values[index] == &out || m_values[index].isInt != first.isInt)
+                return false;
+            total += m_values[index].shape[(size_t)axis];
+        }
+
+        out.shape = first.shape;
+        out.shape[(size_t)axis] = total;
+        resizeLike(first, out);
+        size_t n = 0;
+        for (int64_t o = 0; o < outer; ++o)
+        {
+            for (int index : step.inputs)
+            {
+                const Value& part = m_values[index];
+                int64_t run = part.shape[(size_t)axis] * inner;
+                for (int64_t k = 0; k < run; ++k)
+                    copyElements(part, out, n++, o * run + k);
+            }
+        }
+        return true;
+    }
+
+    // ONNX GRU, gates in z, r, h order; X is [T, B, I], outputs Y [T, 1, B, H] and Y_h [1, B, H]
+    bool gru(const Step& step)
+    {
+        const Value& x = m_values[step.inputs[0]];
+        const Value& w = m_values[step.inputs[1]];
+        const Value& r = m_values[step.inputs[2]];
+        const Value* b = step.inputs.size() > 3 && step.inputs[3] >= 0 ? &m_values[step.inputs[3]] : nullptr;
+        const Value* initial = step.inputs.size() > 5 && step.inputs[5] >= 0 ? &m_values[step.inputs[5]] : nullptr;
+        if (x.isInt || x.shape.size() != 3)
+            return false;
+
+        int64_t steps = x.shape[0], batch = x.shape[1], inputSize = x.shape[2];
+        int64_t hidden = step.rows;
+        if ((int64_t)w.f.size() != 3 * hidden * inputSize || (int64_t)r.f.size() != 3 * hidden * hidden)
+            return false;
+
+        Value* y = step.outputs[0] >= 0 ? &m_values[step.outputs[0]] : nullptr;
+        Value* yh = step.outputs.size() > 1 && step.outputs[1] >= 0 ? &m_values[step.outputs[1]] : nullptr;
+        // the running state lives in Y_h, or in a scratch value when only Y is used
+        Value& state = yh ? *yh : m_scratch;
+        state.isInt = false;
+        state.shape = { 1, batch, hidden };
+        state.f.resize((size_t)(batch * hidden));
+        if (initial)
+            std::copy(initial->f.begin(), initial->f.begin() + state.f.size(), state.f.begin());
+        else
+            std::fill(state.f.begin(), state.f.end(), 0.0f);
+        if (y)
+        {
+            y->isInt = false;
+            y->shape = { steps, 1, batch, hidden };
+            y->f.resize((size_t)(steps * batch * hidden));
+        }
+        m_gates.resize((size_t)(8 * hidden));
+
+        const float* wb = b ? b->f.data() : nullptr;
+        const float* rb = b ? b->f.data() + 3 * hidden : nullptr;
+        float* xg = m_gates.data();
+        float* hg = xg + 3 * hidden;
+        float* resetH = xg + 6 * hidden;
+        float* next = xg + 7 * hidden;
+        for (int64_t t = 0; t < steps; ++t)
+        {
+            for (int64_t n = 0; n < batch; ++n)
+            {
+                const float* xt = x.f.data() + (t * batch + n) * inputSize;
+                float* h = state.f.data() + n * hidden;
+                for (int64_t g = 0; g < 3 * hidden; ++g)
+                {
+                    xg[g] = dot(xt, w.f.data() + g * inputSize, inputSize) + (wb ? wb[g] : 0.0f);
+                    hg[g] = dot(h, r.f.data() + g * hidden, hidden) + (rb ? rb[g] : 0.0f);
+                }
+                // update and reset gates
+                for (int64_t g = 0; g < 2 * hidden; ++g)
+                    xg[g] = sigmoid(xg[g] + hg[g]);
+
+                const float* z = xg;
+                const float* reset = xg + hidden;
+                if (!step.flag)
+                {
+                    // without linear_before_reset the reset applies to h before the recurrent product
+                    for (int64_t k = 0; k < hidden; ++k)
+                        resetH[k] = reset[k] * h[k];
+                    for (int64_t k = 0; k < hidden; ++k)
+                        hg[2 * hidden + k] = dot(resetH, r.f.data() + (2 * hidden + k) * hidden, hidden) + (rb ? rb[2 * hidden + k] : 0.0f);
+                }
+                for (int64_t k = 0; k < hidden; ++k)
+                {
+                    float recurrent = step.flag ? reset[k] * hg[2 * hidden + k] : hg[2 * hidden + k];
+                    float candidate = std::tanh(xg[2 * hidden + k] + recurrent);
+                    next[k] = (1.0f - z[k]) * candidate + z[k] * h[k];
+                }
+                std::copy(next, next + hidden, h);
+                if (y)
+                    std::copy(h, h + hidden, y->f.data() + (t * batch + n) * hidden);
+            }
+        }
+        return true;
+    }
+
+    Value m_scratch;
+    std::vector<float> m_gates;
+    // shape and axes scratch of Reshape and Squeeze/Unsqueeze
+    std::vector<int64_t> m_dims;
+    std::vector<int64_t> m_axes;
+};
+
+#endif
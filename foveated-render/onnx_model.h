@@ -0,0 +1,331 @@
+#ifndef ONNX_MODEL_H
+#define ONNX_MODEL_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "protobuf_reader.h"
+
+// The parts of an ONNX model a small inference engine needs: the graph's
+// nodes in topological order, their attributes and the initializer tensors.
+// Float, int32 and int64 tensors are supported, stored inline (raw_data or the
+// typed fields); externally stored weights are not.
+struct OnnxTensor
+{
+    std::vector<int64_t> dims;
+    // FLOAT tensors fill floats, INT32/INT64 tensors fill ints
+    std::vector<float> floats;
+    std::vector<int64_t> ints;
+    bool isInt = false;
+
+    int64_t elementCount() const
+    {
+        int64_t count = 1;
+        for (int64_t dim : dims)
+            count *= dim;
+        return count;
+    }
+};
+
+struct OnnxAttribute
+{
+    float f = 0.0f;
+    int64_t i = 0;
+    std::string s;
+    std::vector<float> floats;
+    std::vector<int64_t> ints;
+    OnnxTensor t;
+};
+
+struct OnnxNode
+{
+    std::string opType;
+    std::string name;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    std::map<std::string, OnnxAttribute> attributes;
+
+    bool has(const std::string& attribute) const { return attributes.count(attribute) != 0; }
+    int64_t intAttribute(const std::string& attribute, int64_t fallback) const
+    {
+        auto it = attributes.find(attribute);
+        return it == attributes.end() ? fallback : it->second.i;
+    }
+    float floatAttribute(const std::string& attribute, float fallback) const
+    {
+        auto it = attributes.find(attribute);
+        return it == attributes.end() ? fallback : it->second.f;
+    }
+};
+
+class OnnxModel
+{
+public:
+    std::vector<OnnxNode> nodes;
+    std::map<std::string, OnnxTensor> initializers;
+    // graph inputs that are not initializers, and graph outputs
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    int64_t opsetVersion = 0;
+
+    bool load(const std::string& path)
+    {
+        MappedFile file;
+        if (!file.open(path))
+        {
+            std::cout << "ERROR::ONNX_MODEL::" << path << " cannot be mapped" << std::endl;
+            return false;
+        }
+
+        ProtoReader model(file.data(), file.size());
+        bool hasGraph = false;
+        while (model.next())
+        {
+            if (model.field() == 7 && model.wireType() == ProtoReader::LENGTH_DELIMITED)
+            {
+                if (!parseGraph(model.message()))
+                {
+                    std::cout << "ERROR::ONNX_MODEL::" << path << " has a malformed or unsupported graph" << std::endl;
+                    return false;
+                }
+                hasGraph = true;
+            }
+            else if (model.field() == 8 && model.wireType() == ProtoReader::LENGTH_DELIMITED)
+            {
+                // default domain opset
+                ProtoReader opset = model.message();
+                std::string domain;
+                int64_t version = 0;
+                while (opset.next())
+                {
+                    if (opset.field() == 1) domain = opset.string();
+                    else if (opset.field() == 2) version = opset.int64();
+                }
+                if (domain.empty() || domain == "ai.onnx")
+                    opsetVersion = version;
+            }
+        }
+        if (model.failed() || !hasGraph)
+        {
+            std::cout << "ERROR::ONNX_MODEL::" << path << " is not a valid ONNX model" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool parseGraph(ProtoReader graph)
+    {
+        std::vector<std::string> declaredInputs;
+        while (graph.next())
+        {
+            if (graph.wireType() != ProtoReader::LENGTH_DELIMITED)
+                continue;
+            switch (graph.field())
+            {
+            case 1:
+                nodes.emplace_back();
+                if (!parseNode(graph.message(), nodes.back()))
+                    return false;
+                break;
+            case 5:
+            {
+                std::string name;
+                OnnxTensor tensor;
+                if (!parseTensor(graph.message(), tensor, &name))
+                    return false;
+                initializers[name] = std::move(tensor);
+                break;
+            }
+            case 11:
+                declaredInputs.push_back(valueInfoName(graph.message()));
+                break;
+            case 12:
+                outputs.push_back(valueInfoName(graph.message()));
+                break;
+            }
+        }
+        for (const std::string& name : declaredInputs)
+        {
+            if (!initializers.count(name))
+                inputs.push_back(name);
+        }
+        return !graph.failed();
+    }
+
+    static std::string valueInfoName(ProtoReader info)
+    {
+        while (info.next())
+        {
+            if (info.field() == 1)
+                return info.string();
+        }
+        return std::string();
+    }
+
+    static bool parseNode(ProtoReader reader, OnnxNode& node)
+    {
+        while (reader.next())
+        {
+            switch (reader.field())
+            {
+            case 1: node.inputs.push_back(reader.string()); break;
+            case 2: node.outputs.push_back(reader.string()); break;
+            case 3: node.name = reader.string(); break;
+            case 4: node.opType = reader.string(); break;
+            case 5:
+            {
+                std::string name;
+                OnnxAttribute attribute;
+                if (!parseAttribute(reader.message(), name, attribute))
+                    return false;
+                node.attributes[name] = std::move(attribute);
+                break;
+            }
+            case 7:
+            {
+                std::string domain = reader.string();
+                if (!domain.empty() && domain != "ai.onnx")
+                    node.opType = domain + "." + node.opType;
+                break;
+            }
+            }
+        }
+        return !reader.failed();
+    }
+
+    static bool parseAttribute(ProtoReader reader, std::string& name, OnnxAttribute& attribute)
+    {
+        while (reader.next())
+        {
+            switch (reader.field())
+            {
+            case 1: name = reader.string(); break;
+            case 2: attribute.f = reader.fixed32Float(); break;
+            case 3: attribute.i = reader.int64(); break;
+            case 4: attribute.s = reader.string(); break;
+            case 5:
+                if (!parseTensor(reader.message(), attribute.t, nullptr))
+                    return false;
+                break;
+            case 7: readFloats(reader, attribute.floats); break;
+            case 8: readInts(reader, attribute.ints); break;
+            }
+        }
+        return !reader.failed();
+    }
+
+    static bool parseTensor(ProtoReader reader, OnnxTensor& tensor, std::string* name)
+    {
+        int dataType = 0;
+        const uint8_t* raw = nullptr;
+        size_t rawSize = 0;
+        std::vector<float> floats;
+        std::vector<int64_t> ints;
+        while (reader.next())
+        {
+            switch (reader.field())
+            {
+            case 1: readInts(reader, tensor.dims); break;
+            case 2: dataType = (int)reader.varint(); break;
+            case 4: readFloats(reader, floats); break;
+            case 5: // int32_data
+            case 7: // int64_data
+                readInts(reader, ints);
+                break;
+            case 8:
+                if (name)
+                    *name = reader.string();
+                break;
+            case 9:
+                raw = reader.bytes();
+                rawSize = reader.size();
+                break;
+            case 14:
+                // EXTERNAL data location
+                if (reader.varint() == 1)
+                    return false;
+                break;
+            }
+        }
+        if (reader.failed())
+            return false;
+
+        const int FLOAT = 1, INT32 = 6, INT64 = 7;
+        size_t count = (size_t)tensor.elementCount();
+        if (dataType == FLOAT)
+        {
+            if (raw)
+            {
+                if (rawSize != count * sizeof(float))
+                    return false;
+                floats.resize(count);
+                std::memcpy(floats.data(), raw, rawSize);
+            }
+            tensor.floats = std::move(floats);
+            return tensor.floats.size() == count;
+        }
+        if (dataType == INT32 || dataType == INT64)
+        {
+            tensor.isInt = true;
+            if (raw)
+            {
+                size_t elementSize = dataType == INT64 ? 8 : 4;
+                if (rawSize != count * elementSize)
+                    return false;
+                ints.resize(count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (dataType == INT64)
+                        std::memcpy(&ints[i], raw + 8 * i, 8);
+                    else
+                    {
+                        int32_t value;
+                        std::memcpy(&value, raw + 4 * i, 4);
+                        ints[i] = value;
+                    }
+                }
+            }
+            tensor.ints = std::move(ints);
+            return tensor.ints.size() == count;
+        }
+        return false;
+    }
+
+    // repeated scalars may come packed in one length-delimited field or one per field
+    static void readInts(ProtoReader& reader, std::vector<int64_t>& values)
+    {
+        if (reader.wireType() == ProtoReader::LENGTH_DELIMITED)
+        {
+            ProtoReader packed = reader.message();
+            uint64_t value;
+            while (packed.nextPacked(value))
+                values.push_back((int64_t)value);
+        }
+        else
+        {
+            values.push_back(reader.int64());
+        }
+    }
+    static void readFloats(ProtoReader& reader, std::vector<float>& values)
+    {
+        if (reader.wireType() == ProtoReader::LENGTH_DELIMITED)
+        {
+            size_t count = reader.size() / sizeof(float);
+            size_t offset = values.size();
+            values.resize(offset + count);
+            std::memcpy(values.data() + offset, reader.bytes(), count * sizeof(float));
+        }
+        else
+        {
+            values.push_back(reader.fixed32Float());
+        }
+    }
+};
+
+#endif
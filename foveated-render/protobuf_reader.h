@@ -0,0 +1,124 @@
+#ifndef PROTOBUF_READER_H
+#define PROTOBUF_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Minimal reader for the protobuf wire format, enough to walk the messages of
+// an ONNX file without generated code. A reader covers one message; next()
+// steps from field to field and nested messages are read by constructing a
+// reader over bytes(). Any malformed input sets failed() and ends iteration.
+class ProtoReader
+{
+public:
+    enum WireType
+    {
+        VARINT = 0,
+        FIXED64 = 1,
+        LENGTH_DELIMITED = 2,
+        FIXED32 = 5
+    };
+
+    ProtoReader(const uint8_t* data, size_t size) : m_pos(data), m_end(data + size) {}
+
+    // advance to the next field, false at the end of the message or on error
+    bool next()
+    {
+        if (m_failed || m_pos >= m_end)
+            return false;
+        uint64_t key;
+        if (!readVarint(key))
+            return false;
+        m_field = (uint32_t)(key >> 3);
+        m_wireType = (int)(key & 7);
+
+        switch (m_wireType)
+        {
+        case VARINT:
+            return readVarint(m_varint);
+        case FIXED64:
+            return take(8, m_bytes);
+        case FIXED32:
+            return take(4, m_bytes);
+        case LENGTH_DELIMITED:
+        {
+            uint64_t length;
+            return readVarint(length) && take((size_t)length, m_bytes);
+        }
+        default:
+            m_failed = true;
+            return false;
+        }
+    }
+
+    uint32_t field() const { return m_field; }
+    int wireType() const { return m_wireType; }
+    bool failed() const { return m_failed; }
+
+    uint64_t varint() const { return m_varint; }
+    int64_t int64() const { return (int64_t)m_varint; }
+    float fixed32Float() const
+    {
+        float value;
+        std::memcpy(&value, m_bytes, sizeof(value));
+        return value;
+    }
+
+    // payload of a length-delimited field
+    const uint8_t* bytes() const { return m_bytes; }
+    size_t size() const { return m_size; }
+    ProtoReader message() const { return ProtoReader(m_bytes, m_size); }
+    std::string string() const { return std::string((const char*)m_bytes, m_size); }
+
+    // read one varint from a packed repeated field, false when it is used up
+    bool nextPacked(uint64_t& value)
+    {
+        if (m_pos >= m_end)
+            return false;
+        return readVarint(value);
+    }
+
+private:
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+    bool m_failed = false;
+
+    uint32_t m_field = 0;
+    int m_wireType = 0;
+    uint64_t m_varint = 0;
+    const uint8_t* m_bytes = nullptr;
+    size_t m_size = 0;
+
+    bool readVarint(uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (m_pos >= m_end)
+                break;
+            uint8_t byte = *m_pos++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        m_failed = true;
+        return false;
+    }
+
+    bool take(size_t size, const uint8_t*& bytes)
+    {
+        if ((size_t)(m_end - m_pos) < size)
+        {
+            m_failed = true;
+            return false;
+        }
+        bytes = m_pos;
+        m_size = size;
+        m_pos += size;
+        return true;
+    }
+};
+
+#endif
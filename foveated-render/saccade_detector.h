@@ -0,0 +1,136 @@
+#ifndef SACCADE_DETECTOR_H
+#define SACCADE_DETECTOR_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+struct SaccadeDetectorParams
+{
+    // velocity and acceleration are measured across this span, which has to
+    // average out the tracker noise of consecutive samples
+    float spanMs = 5.0f;
+    // a saccade starts above onsetVelocity, or above offsetVelocity while
+    // accelerating faster than onsetAcceleration (which catches it a few
+    // samples earlier), and ends below offsetVelocity
+    float onsetVelocityDegPerSecond = 80.0f;
+    float onsetAccelerationDegPerSecond2 = 15000.0f;
+    float offsetVelocityDegPerSecond = 40.0f;
+    // longer movements are not saccades (pursuit, head motion, tracker glitches)
+    float maxSaccadeMs = 150.0f;
+};
+
+// I-VT style saccade detector on a stream of gaze samples in degrees. Feed every
+// valid sample in order; the state switches to SACCADE at the onset and back to
+// FIXATION once the eye has slowed down. Between the two velocity thresholds
+// the state is kept, so noise around a single threshold does not toggle it.
+class SaccadeDetector
+{
+public:
+    enum State
+    {
+        FIXATION,
+        SACCADE
+    };
+
+    explicit SaccadeDetector(const SaccadeDetectorParams& params = SaccadeDetectorParams()) : m_params(params) {}
+
+    void reset()
+    {
+        m_next = 0;
+        m_count = 0;
+        m_state = FIXATION;
+        m_tooLong = false;
+        m_velocity = 0.0f;
+        m_acceleration = 0.0f;
+        m_saccadeStartUs = 0;
+        m_saccadeCount = 0;
+    }
+
+    State update(int64_t timestampUs, float xDeg, float yDeg)
+    {
+        const int64_t spanUs = (int64_t)(m_params.spanMs * 1000.0f);
+
+        // newest sample at least one span older than this one, or the oldest kept
+        const Sample* reference = nullptr;
+        for (int i = 1; i <= m_count; ++i)
+        {
+            reference = &m_samples[(m_next - i + HISTORY) % HISTORY];
+            if (timestampUs - reference->timestampUs >= spanUs)
+                break;
+        }
+
+        if (reference && timestampUs > reference->timestampUs)
+        {
+            float dt = (timestampUs - reference->timestampUs) * 1e-6f;
+            float dx = xDeg - reference->xDeg;
+            float dy = yDeg - reference->yDeg;
+            m_velocity = std::sqrt(dx * dx + dy * dy) / dt;
+            m_acceleration = (m_velocity - reference->velocity) / dt;
+        }
+
+        m_samples[m_next] = { timestampUs, xDeg, yDeg, m_velocity };
+        m_next = (m_next + 1) % HISTORY;
+        if (m_count < HISTORY)
+            ++m_count;
+
+        if (m_state == FIXATION)
+        {
+            bool onset = m_velocity > m_params.onsetVelocityDegPerSecond
+                || (m_velocity > m_params.offsetVelocityDegPerSecond && m_acceleration > m_params.onsetAccelerationDegPerSecond2);
+            if (onset && !m_tooLong)
+            {
+                m_state = SACCADE;
+                m_saccadeStartUs = timestampUs;
+                ++m_saccadeCount;
+            }
+        }
+        else if (m_velocity < m_params.offsetVelocityDegPerSecond)
+        {
+            m_state = FIXATION;
+        }
+        else if (timestampUs - m_saccadeStartUs > (int64_t)(m_params.maxSaccadeMs * 1000.0f))
+        {
+            // not a saccade, wait for the eye to slow down before arming again
+            m_state = FIXATION;
+            m_tooLong = true;
+        }
+        if (m_velocity < m_params.offsetVelocityDegPerSecond)
+            m_tooLong = false;
+        return m_state;
+    }
+
+    State state() const { return m_state; }
+    bool inSaccade() const { return m_state == SACCADE; }
+    float velocity() const { return m_velocity; }
+    float acceleration() const { return m_acceleration; }
+    // tracker timestamp of the sample the current or last saccade was detected at
+    int64_t saccadeStartUs() const { return m_saccadeStartUs; }
+    uint64_t saccadeCount() const { return m_saccadeCount; }
+
+private:
+    // enough for the span at tracker rates up to a few kHz
+    static const int HISTORY = 32;
+
+    struct Sample
+    {
+        int64_t timestampUs;
+        float xDeg;
+        float yDeg;
+        float velocity;
+    };
+
+    SaccadeDetectorParams m_params;
+    std::array<Sample, HISTORY> m_samples = {};
+    int m_next = 0;
+    int m_count = 0;
+
+    State m_state = FIXATION;
+    bool m_tooLong = false;
+    float m_velocity = 0.0f;
+    float m_acceleration = 0.0f;
+    int64_t m_saccadeStartUs = 0;
+    uint64_t m_saccadeCount = 0;
+};
+
+#endif
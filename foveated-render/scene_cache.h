@@ -0,0 +1,337 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+
+// Binary cache of an imported scene, written next to the source model so later
+// starts skip Assimp. The file is laid out to be memory mapped and used in
+// place: fixed-size tables up front, then every mesh's vertices and indices as
+// 16 byte aligned blocks that go to the GL buffers as they are. Little endian,
+// native struct layout:
+//
+//     Header
+//     MeshRecord[meshCount]
+//     TextureRecord[textureCount]     type and path, as ranges of the string block
+//     char strings[stringBytes]
+//     per mesh, at the offsets of its record: Vertex[vertexCount], uint32[indexCount]
+//
+// A cache only matches the source content (FNV-1a over the model file and the
+// material libraries it names), the Assimp post-processing flags and the
+// Vertex layout it was written with. The textures themselves are not part of
+// the key, they are referenced by path and loaded as before.
+namespace SceneCache
+{
+    const char MAGIC[4] = { 'S', 'C', 'N', 'C' };
+    const uint32_t VERSION = 2;
+    const uint64_t ALIGNMENT = 16;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t importFlags;
+        uint32_t meshCount;
+        uint32_t textureCount;
+        uint32_t vertexSize;
+        uint32_t stringBytes;
+        uint32_t reserved;
+    };
+
+    struct MeshRecord
+    {
+        // byte offsets from the start of the file
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t firstTexture;
+        uint32_t textureCount;
+        float shininess;
+        float diffuseColor[3];
+        float specularColor[3];
+        uint32_t reserved;
+    };
+
+    struct TextureRecord
+    {
+        uint32_t typeOffset;
+        uint32_t typeLength;
+        uint32_t pathOffset;
+        uint32_t pathLength;
+    };
+
+    static_assert(sizeof(Header) == 40 && sizeof(MeshRecord) == 64 && sizeof(TextureRecord) == 16,
+        "scene cache layout must not depend on padding");
+
+    inline std::string cachePath(const std::string& sourcePath)
+    {
+        return sourcePath + ".scenecache";
+    }
+
+    inline uint64_t align(uint64_t offset)
+    {
+        return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+    // FNV-1a over size bytes, continuing from hash
+    inline uint64_t hashBytes(uint64_t hash, const uint8_t* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ data[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    // FNV-1a over the model file followed by every material library an OBJ
+    // names on an mtllib line, relative to its directory as Assimp resolves
+    // them, so editing a material invalidates the cache too. Each library's
+    // name goes in before its bytes, a missing one changes the key once it
+    // appears. False if the model itself cannot be read.
+    inline bool hashSource(const std::string& path, uint64_t& hash)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        hash = hashBytes(FNV_OFFSET_BASIS, file.data(), file.size());
+
+        std::filesystem::path source(path);
+        std::string extension = source.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (extension != ".obj")
+            return true;
+
+        const char* text = (const char*)file.data();
+        const size_t size = file.size();
+        auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+        for (size_t line = 0; line < size;)
+        {
+            size_t end = line;
+            while (end < size && text[end] != '\n')
+                ++end;
+            size_t first = line;
+            while (first < end && blank(text[first]))
+                ++first;
+            if (end - first > 7 && std::memcmp(text + first, "mtllib", 6) == 0 && blank(text[first + 6]))
+            {
+                first += 7;
+                size_t last = end;
+                while (first < last && blank(text[first]))
+                    ++first;
+                while (last > first && blank(text[last - 1]))
+                    --last;
+                std::string name(text + first, last - first);
+                hash = hashBytes(hash, (const uint8_t*)name.c_str(), name.size() + 1);
+                MappedFile library;
+                if (library.open((source.parent_path() / name).string()))
+                    hash = hashBytes(hash, library.data(), library.size());
+            }
+            line = end + 1;
+        }
+        return true;
+    }
+
+    // written to a temporary file and renamed, an interrupted write leaves no cache behind
+    inline bool write(const std::string& path, uint64_t sourceHash, uint32_t importFlags, const std::vector<Mesh>& meshes)
+    {
+        // tables first, they fix where the geometry starts
+        std::vector<MeshRecord> meshRecords(meshes.size());
+        std::vector<TextureRecord> textureRecords;
+        std::string strings;
+        for (size_t m = 0; m < meshes.size(); ++m)
+        {
+            const Mesh& mesh = meshes[m];
+            MeshRecord& record = meshRecords[m];
+            record = {};
+            record.vertexCount = (uint32_t)mesh.vertices.size();
+            record.indexCount = (uint32_t)mesh.indices.size();
+            record.firstTexture = (uint32_t)textureRecords.size();
+            record.textureCount = (uint32_t)mesh.textures.size();
+            record.shininess = mesh.shininess;
+            for (int i = 0; i < 3; ++i)
+            {
+                record.diffuseColor[i] = mesh.diffuseColor[i];
+                record.specularColor[i] = mesh.specularColor[i];
+            }
+            for (const Texture& texture : mesh.textures)
+            {
+                TextureRecord textureRecord;
+                textureRecord.typeOffset = (uint32_t)strings.size();
+                textureRecord.typeLength = (uint32_t)texture.type.size();
+                strings += texture.type;
+                textureRecord.pathOffset = (uint32_t)strings.size();
+                textureRecord.pathLength = (uint32_t)texture.path.size();
+                strings += texture.path;
+                textureRecords.push_back(textureRecord);
+            }
+        }
+        uint64_t offset = sizeof(Header) + meshRecords.size() * sizeof(MeshRecord)
+            + textureRecords.size() * sizeof(TextureRecord) + strings.size();
+        for (MeshRecord& record : meshRecords)
+        {
+            record.vertexOffset = offset = align(offset);
+            offset += (uint64_t)record.vertexCount * sizeof(Vertex);
+            record.indexOffset = offset = align(offset);
+            offset += (uint64_t)record.indexCount * sizeof(uint32_t);
+        }
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                std::cout << "ERROR::SCENE_CACHE::" << temporary << " cannot be written" << std::endl;
+                return false;
+            }
+
+            Header header = {};
+            std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.sourceHash = sourceHash;
+            header.importFlags = importFlags;
+            header.meshCount = (uint32_t)meshRecords.size();
+            header.textureCount = (uint32_t)textureRecords.size();
+            header.vertexSize = sizeof(Vertex);
+            header.stringBytes = (uint32_t)strings.size();
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)meshRecords.data(), meshRecords.size() * sizeof(MeshRecord));
+            out.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+            out.write(strings.data(), strings.size());
+
+            const char padding[ALIGNMENT] = {};
+            auto padTo = [&out, &padding](uint64_t target)
+            {
+                uint64_t position = (uint64_t)out.tellp();
+                out.write(padding, (std::streamsize)(target - position));
+            };
+            for (size_t m = 0; m < meshes.size(); ++m)
+            {
+                padTo(meshRecords[m].vertexOffset);
+                out.write((const char*)meshes[m].vertices.data(), meshes[m].vertices.size() * sizeof(Vertex));
+                padTo(meshRecords[m].indexOffset);
+                out.write((const char*)meshes[m].indices.data(), meshes[m].indices.size() * sizeof(uint32_t));
+            }
+            if (!out)
+            {
+                std::cout << "ERROR::SCENE_CACHE::" << temporary << " could not be written completely" << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(temporary, path, ec);
+        if (ec)
+        {
+            std::cout << "ERROR::SCENE_CACHE::" << path << " cannot be replaced: " << ec.message() << std::endl;
+            std::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+}
+
+// A scene cache mapped read-only. Vertex and index pointers point into the
+// mapping and are only valid while the reader is open; nothing is copied on
+// the CPU side, the pages are read in as GL consumes them.
+class SceneCacheReader
+{
+public:
+    // false if there is no valid cache for this source and flags
+    bool open(const std::string& path, uint64_t sourceHash, uint32_t importFlags)
+    {
+        if (!m_file.open(path))
+            return false;
+        if (!validate(sourceHash, importFlags))
+        {
+            m_file.close();
+            return false;
+        }
+        return true;
+    }
+    void close() { m_file.close(); }
+
+    uint32_t meshCount() const { return header().meshCount; }
+    const SceneCache::MeshRecord& mesh(uint32_t i) const { return meshRecords()[i]; }
+    const Vertex* vertices(uint32_t i) const { return (const Vertex*)(m_file.data() + mesh(i).vertexOffset); }
+    const uint32_t* indices(uint32_t i) const { return (const uint32_t*)(m_file.data() + mesh(i).indexOffset); }
+
+    // textures of mesh i, type and path only
+    std::vector<Texture> textures(uint32_t i) const
+    {
+        std::vector<Texture> textures(mesh(i).textureCount);
+        for (uint32_t t = 0; t < mesh(i).textureCount; ++t)
+        {
+            const SceneCache::TextureRecord& record = textureRecords()[mesh(i).firstTexture + t];
+            textures[t].id = 0;
+            textures[t].type.assign(strings() + record.typeOffset, record.typeLength);
+            textures[t].path.assign(strings() + record.pathOffset, record.pathLength);
+        }
+        return textures;
+    }
+
+private:
+    MappedFile m_file;
+
+    const SceneCache::Header& header() const { return *(const SceneCache::Header*)m_file.data(); }
+    const SceneCache::MeshRecord* meshRecords() const
+    {
+        return (const SceneCache::MeshRecord*)(m_file.data() + sizeof(SceneCache::Header));
+    }
+    const SceneCache::TextureRecord* textureRecords() const
+    {
+        return (const SceneCache::TextureRecord*)(meshRecords() + header().meshCount);
+    }
+    const char* strings() const { return (const char*)(textureRecords() + header().textureCount); }
+
+    // every record has to stay inside the file, the mapping is used without further checks
+    bool validate(uint64_t sourceHash, uint32_t importFlags) const
+    {
+        const uint64_t size = m_file.size();
+        if (size < sizeof(SceneCache::Header))
+            return false;
+        const SceneCache::Header& h = header();
+        if (std::memcmp(h.magic, SceneCache::MAGIC, sizeof(h.magic)) != 0
+            || h.version != SceneCache::VERSION || h.vertexSize != sizeof(Vertex)
+            || h.sourceHash != sourceHash || h.importFlags != importFlags)
+            return false;
+
+        uint64_t tables = sizeof(SceneCache::Header) + (uint64_t)h.meshCount * sizeof(SceneCache::MeshRecord)
+            + (uint64_t)h.textureCount * sizeof(SceneCache::TextureRecord) + h.stringBytes;
+        if (tables > size)
+            return false;
+        for (uint32_t t = 0; t < h.textureCount; ++t)
+        {
+            const SceneCache::TextureRecord& record = textureRecords()[t];
+            if ((uint64_t)record.typeOffset + record.typeLength > h.stringBytes
+                || (uint64_t)record.pathOffset + record.pathLength > h.stringBytes)
+                return false;
+        }
+        for (uint32_t m = 0; m < h.meshCount; ++m)
+        {
+            const SceneCache::MeshRecord& record = meshRecords()[m];
+            if ((uint64_t)record.firstTexture + record.textureCount > h.textureCount
+                || record.vertexOffset % SceneCache::ALIGNMENT != 0 || record.indexOffset % SceneCache::ALIGNMENT != 0
+                || record.vertexOffset < tables || record.indexOffset < tables
+                || record.vertexOffset > size || record.indexOffset > size
+                // subtracted rather than added, a corrupt offset must not wrap around
+                || (uint64_t)record.vertexCount * sizeof(Vertex) > size - record.vertexOffset
+                || (uint64_t)record.indexCount * sizeof(uint32_t) > size - record.indexOffset)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer slot for a small trivially copyable value. The writer never
+// blocks and readers never block the writer: a reader that overlaps a store
+// simply retries. The value is kept in relaxed atomic words so a torn read is
+// detected by the sequence check rather than being a data race.
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+
+public:
+    Seqlock() {}
+
+    Seqlock(const Seqlock&) = delete;
+    Seqlock& operator=(const Seqlock&) = delete;
+
+    // writer side, only ever called from one thread
+    void store(const T& value)
+    {
+        uint32_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i)
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // copy of the newest value; returns the number of stores so far, 0 means value was left untouched
+    uint64_t load(T& value) const
+    {
+        uint32_t words[WORDS];
+        uint64_t before, after;
+        do
+        {
+            before = m_seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i)
+                words[i] = m_words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_seq.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        if (before == 0)
+            return 0;
+        std::memcpy(&value, words, sizeof(T));
+        return before / 2;
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    alignas(64) std::atomic<uint64_t> m_seq{ 0 };
+    std::atomic<uint32_t> m_words[WORDS] = {};
+};
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef SHADING_RATE_IMAGE_H
+#define SHADING_RATE_IMAGE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "constants.h"
+
+// Owns the R8UI shading rate image consumed by GL_NV_shading_rate_image.
+// The immutable storage is allocated once per framebuffer resolution; per-frame
+// updates only re-upload the sub-rectangle of texels marked dirty since the
+// previous upload.
+//
+// When persistent buffer mapping is available the dirty texels are staged in a
+// ring of pixel unpack buffers, so glTexSubImage2D becomes a GPU-side copy. A
+// fence per ring slot guards reuse; a slot the GPU still reads from is never
+// waited on, that frame falls back to a plain client-memory upload instead.
+class ShadingRateImage
+{
+public:
+    static const int RING_SIZE = 3;
+
+    ShadingRateImage() {}
+
+    ShadingRateImage(const ShadingRateImage&) = delete;
+    ShadingRateImage& operator=(const ShadingRateImage&) = delete;
+
+    // query the shading rate texel size, must be called with a current context
+    // ------------------------------------------------------------------------
+    void init(bool usePersistentMapping)
+    {
+        glGetIntegerv(NVShadingRate::TEXEL_WIDTH, &m_texelWidth);
+        glGetIntegerv(NVShadingRate::TEXEL_HEIGHT, &m_texelHeight);
+        if (m_texelWidth <= 0) m_texelWidth = 16;
+        if (m_texelHeight <= 0) m_texelHeight = 16;
+        m_persistent = usePersistentMapping;
+    }
+    // (re)allocate storage for a framebuffer size, no-op if the size is unchanged
+    // ------------------------------------------------------------------------
+    void resize(int framebufferWidth, int framebufferHeight)
+    {
+        if (framebufferWidth <= 0 || framebufferHeight <= 0)
+            return;
+
+        uint32_t width = (framebufferWidth + m_texelWidth - 1) / m_texelWidth;
+        uint32_t height = (framebufferHeight + m_texelHeight - 1) / m_texelHeight;
+        if (m_texture && width == m_width && height == m_height)
+            return;
+
+        destroy();
+        m_width = width;
+        m_height = height;
+        m_data.assign(m_width * m_height, 0);
+        markDirty(0, 0, m_width, m_height);
+
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8UI, m_width, m_height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (m_persistent && !createRing())
+        {
+            std::cerr << "Failed to map shading rate upload buffers, using synchronous uploads" << std::endl;
+            destroyRing();
+            m_persistent = false;
+        }
+    }
+    // grow the pending upload region by the half-open texel rectangle [x0,x1) x [y0,y1)
+    // ------------------------------------------------------------------------
+    void markDirty(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+    {
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        if (!isDirty())
+        {
+            m_dirtyX0 = x0; m_dirtyY0 = y0;
+            m_dirtyX1 = x1; m_dirtyY1 = y1;
+            return;
+        }
+        m_dirtyX0 = std::min(m_dirtyX0, x0);
+        m_dirtyY0 = std::min(m_dirtyY0, y0);
+        m_dirtyX1 = std::max(m_dirtyX1, x1);
+        m_dirtyY1 = std::max(m_dirtyY1, y1);
+    }
+    // the texture was written behind our back (e.g. by a compute pass), resend everything next upload
+    // ------------------------------------------------------------------------
+    void invalidate()
+    {
+        markDirty(0, 0, m_width, m_height);
+    }
+    bool isDirty() const
+    {
+        return m_dirtyX0 < m_dirtyX1 && m_dirtyY0 < m_dirtyY1;
+    }
+    // copy the dirty CPU-side texels into the existing storage, no-op when clean
+    // ------------------------------------------------------------------------
+    void upload()
+    {
+        if (!m_texture || !isDirty())
+            return;
+
+        uint32_t w = m_dirtyX1 - m_dirtyX0;
+        uint32_t h = m_dirtyY1 - m_dirtyY0;
+        size_t offset = (size_t)m_dirtyY0 * m_width + m_dirtyX0;
+
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_width);
+
+        RingSlot* slot = isStreaming() ? acquireSlot() : nullptr;
+        if (slot)
+        {
+            // stage the dirty rows at the same offsets they have in m_data
+            for (uint32_t y = m_dirtyY0; y < m_dirtyY1; ++y)
+            {
+                size_t row = (size_t)y * m_width + m_dirtyX0;
+                std::memcpy(slot->mapped + row, m_data.data() + row, w);
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, m_dirtyX0, m_dirtyY0, w, h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, (const void*)offset);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, m_dirtyX0, m_dirtyY0, w, h, GL_RED_INTEGER, GL_UNSIGNED_BYTE, m_data.data() + offset);
+        }
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        m_dirtyX0 = m_dirtyY0 = m_dirtyX1 = m_dirtyY1 = 0;
+    }
+
+    uint8_t* data() { return m_data.data(); }
+    GLuint texture() const { return m_texture; }
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    GLint texelWidth() const { return m_texelWidth; }
+    GLint texelHeight() const { return m_texelHeight; }
+    bool isStreaming() const { return m_ring[0].mapped != nullptr; }
+
+    // delete the GL objects, must be called before the context goes away
+    // ------------------------------------------------------------------------
+    void destroy()
+    {
+        destroyRing();
+        if (m_texture)
+        {
+            glDeleteTextures(1, &m_texture);
+            m_texture = 0;
+        }
+    }
+
+private:
+    struct RingSlot
+    {
+        GLuint buffer = 0;
+        uint8_t* mapped = nullptr;
+        GLsync fence = nullptr;
+    };
+
+    GLuint m_texture = 0;
+    std::vector<uint8_t> m_data;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    GLint m_texelWidth = 16;
+    GLint m_texelHeight = 16;
+
+    uint32_t m_dirtyX0 = 0, m_dirtyY0 = 0;
+    uint32_t m_dirtyX1 = 0, m_dirtyY1 = 0;
+
+    bool m_persistent = false;
+    RingSlot m_ring[RING_SIZE];
+    int m_slot = 0;
+
+    bool createRing()
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = (GLsizeiptr)m_width * m_height;
+
+        bool ok = true;
+        for (RingSlot& slot : m_ring)
+        {
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            slot.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            ok &= slot.mapped != nullptr;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return ok;
+    }
+    void destroyRing()
+    {
+        for (RingSlot& slot : m_ring)
+        {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            if (slot.buffer)
+            {
+                if (slot.mapped)
+                {
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                }
+                glDeleteBuffers(1, &slot.buffer);
+            }
+            slot = RingSlot();
+        }
+        m_slot = 0;
+    }
+    // next ring slot if the GPU is done reading from it, nullptr otherwise
+    RingSlot* acquireSlot()
+    {
+        RingSlot& slot = m_ring[m_slot];
+        if (slot.fence)
+        {
+            GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+                return nullptr;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        m_slot = (m_slot + 1) % RING_SIZE;
+        return &slot;
+    }
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer
+// thread. Capacity must be a power of two; push() fails instead of blocking
+// when the ring is full, so the producer never waits on the consumer.
+//
+// Head and tail live on separate cache lines and each side keeps a cached copy
+// of the other side's index, so the shared indices are only re-read when the
+// ring looks full (producer) or empty (consumer).
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // producer side, false if the ring is full
+    bool push(const T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead == Capacity)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead == Capacity)
+                return false;
+        }
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, false if the ring is empty
+    bool pop(T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+                return false;
+        }
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called while the other side is running
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    // consumer
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    size_t m_cachedTail = 0;
+    // producer
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    size_t m_cachedHead = 0;
+
+    alignas(64) T m_items[Capacity];
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef SYNTHETIC_GAZE_SOURCE_H
+#define SYNTHETIC_GAZE_SOURCE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "gaze_source.h"
+
+// Parameters of the synthetic eye. Angles are in degrees from the screen
+// center, durations in seconds.
+struct SyntheticGazeParams
+{
+    float sampleRateHz = 1200.0f;
+    uint32_t seed = 1;
+
+    // screen geometry, used to turn angles into tracker coordinates
+    float screenWidthMM = 376.0f;
+    float screenHeightMM = 212.0f;
+    float viewingDistanceMM = 600.0f;
+
+    float fixationMin = 0.15f;
+    float fixationMax = 0.40f;
+    // measurement noise added to every sample (standard deviation)
+    float noiseDeg = 0.05f;
+
+    float saccadeMinDeg = 2.0f;
+    float saccadeMaxDeg = 20.0f;
+
+    // fraction of movements that are smooth pursuit instead of saccades
+    float pursuitProbability = 0.2f;
+    float pursuitMinSpeed = 5.0f;
+    float pursuitMaxSpeed = 20.0f;
+    float pursuitMin = 0.5f;
+    float pursuitMax = 1.5f;
+};
+
+// Generates a tracker-like gaze stream without hardware: fixations with
+// measurement noise, saccades and smooth pursuit, sampled at sampleRateHz and
+// paced by the wall clock.
+//
+// Saccade durations follow the amplitude-duration main sequence,
+// D = 21 ms + 2.2 ms per degree, and positions follow a minimum-jerk profile,
+// which gives the bell-shaped velocity curve of real saccades with a peak of
+// 1.875 * A / D (about 440 deg/s for a 10 degree saccade). Pursuit moves at a
+// constant speed. Every movement stays inside 90% of the screen.
+class SyntheticGazeSource : public GazeSource
+{
+public:
+    explicit SyntheticGazeSource(const SyntheticGazeParams& params = SyntheticGazeParams())
+        : m_params(params), m_random(params.seed),
+        m_period(1.0 / params.sampleRateHz)
+    {
+        const double radToDeg = 180.0 / 3.14159265358979323846;
+        m_limitX = 0.9f * (float)(std::atan(0.5 * params.screenWidthMM / params.viewingDistanceMM) * radToDeg);
+        m_limitY = 0.9f * (float)(std::atan(0.5 * params.screenHeightMM / params.viewingDistanceMM) * radToDeg);
+        startFixation();
+    }
+
+    void poll(GazeSink& sink) override
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!m_started)
+        {
+            m_start = now;
+            m_started = true;
+        }
+        double elapsed = std::chrono::duration<double>(now - m_start).count();
+
+        while (m_time <= elapsed)
+        {
+            if (!m_hasPending)
+            {
+                m_pending = sampleAt(m_time);
+                m_hasPending = true;
+            }
+            if (!sink.push(m_pending))
+                return;
+            m_hasPending = false;
+            m_time += m_period;
+        }
+    }
+
+    const char* name() const override { return "synthetic"; }
+
+private:
+    enum Movement
+    {
+        FIXATION,
+        SACCADE,
+        PURSUIT
+    };
+
+    SyntheticGazeParams m_params;
+    std::mt19937 m_random;
+    double m_period;
+    float m_limitX;
+    float m_limitY;
+
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_start;
+    // time of the next sample, seconds since the first poll
+    double m_time = 0.0;
+    GazeSample m_pending = {};
+    bool m_hasPending = false;
+
+    Movement m_movement = FIXATION;
+    double m_movementStart = 0.0;
+    double m_movementDuration = 0.0;
+    float m_fromX = 0.0f, m_fromY = 0.0f;
+    float m_toX = 0.0f, m_toY = 0.0f;
+
+    float uniform(float low, float high)
+    {
+        return std::uniform_real_distribution<float>(low, high)(m_random);
+    }
+
+    void startFixation()
+    {
+        m_movement = FIXATION;
+        m_toX = m_fromX;
+        m_toY = m_fromY;
+        m_movementDuration = uniform(m_params.fixationMin, m_params.fixationMax);
+    }
+
+    // pick a movement target at distance from the current position that stays on screen
+    void pickTarget(float distance)
+    {
+        for (int attempt = 0; attempt < 16; ++attempt)
+        {
+            float angle = uniform(0.0f, 6.2831853f);
+            float x = m_fromX + distance * std::cos(angle);
+            float y = m_fromY + distance * std::sin(angle);
+            if (std::abs(x) <= m_limitX && std::abs(y) <= m_limitY)
+            {
+                m_toX = x;
+                m_toY = y;
+                return;
+            }
+        }
+        // nothing fits, head back towards the center instead
+        float length = std::sqrt(m_fromX * m_fromX + m_fromY * m_fromY);
+        float step = length > 0.0f ? std::min(distance, length) / length : 0.0f;
+        m_toX = m_fromX - m_fromX * step;
+        m_toY = m_fromY - m_fromY * step;
+    }
+
+    void startMovement()
+    {
+        if (uniform(0.0f, 1.0f) < m_params.pursuitProbability)
+        {
+            m_movement = PURSUIT;
+            m_movementDuration = uniform(m_params.pursuitMin, m_params.pursuitMax);
+            pickTarget(uniform(m_params.pursuitMinSpeed, m_params.pursuitMaxSpeed) * (float)m_movementDuration);
+        }
+        else
+        {
+            m_movement = SACCADE;
+            pickTarget(uniform(m_params.saccadeMinDeg, m_params.saccadeMaxDeg));
+            float amplitude = std::hypot(m_toX - m_fromX, m_toY - m_fromY);
+            m_movementDuration = 0.021 + 0.0022 * amplitude;
+        }
+    }
+
+    // advance the movement sequence to time t and return the sample there
+    GazeSample sampleAt(double t)
+    {
+        while (t >= m_movementStart + m_movementDuration)
+        {
+            m_movementStart += m_movementDuration;
+            m_fromX = m_toX;
+            m_fromY = m_toY;
+            if (m_movement == FIXATION)
+                startMovement();
+            else
+                startFixation();
+        }
+
+        float progress = (float)((t - m_movementStart) / m_movementDuration);
+        if (m_movement == SACCADE)
+            progress = progress * progress * progress * (10.0f + progress * (-15.0f + progress * 6.0f));
+
+        std::normal_distribution<float> noise(0.0f, m_params.noiseDeg);
+        float xDeg = m_fromX + (m_toX - m_fromX) * progress + noise(m_random);
+        float yDeg = m_fromY + (m_toY - m_fromY) * progress + noise(m_random);
+
+        const float degToRad = 3.14159265358979323846f / 180.0f;
+        GazeSample sample;
+        sample.timestampUs = (int64_t)std::llround(t * 1e6);
+        sample.x = std::tan(xDeg * degToRad) * m_params.viewingDistanceMM / (0.5f * m_params.screenWidthMM);
+        sample.y = std::tan(yDeg * degToRad) * m_params.viewingDistanceMM / (0.5f * m_params.screenHeightMM);
+        sample.valid = true;
+        return sample;
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compressed_texture.h"
+#include "worker_pool.h"
+
+// Loads image files on a worker pool while the GL thread carries on, e.g.
+// with the geometry of the same model. Workers map the block compressed
+// texture cache of each image, or decode and compress it when there is no
+// valid cache yet. request() hands out the texture name right away; the GL
+// thread then calls uploadReady() whenever it has a moment and finish() at
+// the end, and the images are uploaded in the order their loads complete.
+// Only request(), uploadReady() and finish() touch GL and they must be called
+// on the context thread.
+class TextureLoader
+{
+public:
+    explicit TextureLoader(unsigned threadCount) : m_pool(threadCount) {}
+    ~TextureLoader() { finish(); }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // queue filename for loading, before start()
+    unsigned int request(const std::string& filename, bool normalMap)
+    {
+        Job job;
+        job.filename = filename;
+        job.normalMap = normalMap;
+        glGenTextures(1, &job.id);
+        m_jobs.push_back(std::move(job));
+        return m_jobs.back().id;
+    }
+
+    // begin loading every requested image
+    void start()
+    {
+        if (m_decoder.joinable() || m_jobs.empty())
+            return;
+        m_start = std::chrono::high_resolution_clock::now();
+        m_decoder = std::thread([this]
+        {
+            auto decode = [this](int index)
+            {
+                Job& job = m_jobs[index];
+                job.image = std::make_unique<CompressedImage>();
+                job.loaded = TextureCache::load(job.filename, job.normalMap, *job.image, job.compressed);
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_ready.push_back(index);
+                }
+                m_decoded.notify_one();
+            };
+            // this thread takes part in run() as well
+            m_pool.run((int)m_jobs.size(), decode);
+        });
+    }
+
+    // upload the images loaded so far, returns how many
+    int uploadReady()
+    {
+        std::vector<int> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ready.swap(m_ready);
+        }
+        for (int index : ready)
+            upload(m_jobs[index]);
+        m_uploaded += (int)ready.size();
+        return (int)ready.size();
+    }
+
+    // wait for the remaining loads and upload them
+    void finish()
+    {
+        if (!m_decoder.joinable())
+            return;
+        while (m_uploaded < (int)m_jobs.size())
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_decoded.wait(lock, [this] { return !m_ready.empty(); });
+            }
+            uploadReady();
+        }
+        m_decoder.join();
+        int compressed = 0;
+        for (const Job& job : m_jobs)
+            compressed += job.compressed ? 1 : 0;
+        std::cout << "Textures: " << m_jobs.size() << " loaded, " << compressed << " compressed first, on " << m_pool.concurrency() << " threads in "
+            << std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count() << " ms" << std::endl;
+    }
+
+private:
+    struct Job
+    {
+        std::string filename;
+        bool normalMap = false;
+        unsigned int id = 0;
+        std::unique_ptr<CompressedImage> image;
+        bool loaded = false;
+        bool compressed = false;
+    };
+
+    WorkerPool m_pool;
+    std::thread m_decoder;
+    // only resized before start(), the workers fill in their own job
+    std::vector<Job> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_decoded;
+    std::vector<int> m_ready;
+    int m_uploaded = 0;
+    std::chrono::high_resolution_clock::time_point m_start;
+
+    static void upload(Job& job)
+    {
+        if (job.loaded)
+            uploadCompressedImage(job.id, *job.image);
+        else
+            std::cout << "Texture failed to load at path: " << job.filename << std::endl;
+        job.image.reset();
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// GL textures by image file, shared by every Model. Paths are normalized
+// before lookup, so "a/../tex/b.png" and "tex\b.png" relative to the same
+// directory find the same texture. Each model acquires a texture once and
+// releases it when it goes away; the texture is deleted with its last user.
+// Main (GL) thread only.
+class TextureRegistry
+{
+public:
+    static TextureRegistry& shared()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    static std::string normalize(const std::string& filename)
+    {
+        // model files written on Windows use backslashes, which std::filesystem
+        // only treats as separators there
+        std::string key = filename;
+        std::replace(key.begin(), key.end(), '\\', '/');
+        key = std::filesystem::path(key).lexically_normal().generic_string();
+#ifdef _WIN32
+        // the file system is case insensitive
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+#endif
+        return key;
+    }
+
+    // texture of filename with one more reference, load() creates it on first use
+    template <typename Load>
+    unsigned int acquire(const std::string& filename, Load load)
+    {
+        auto inserted = m_textures.try_emplace(normalize(filename));
+        Entry& entry = inserted.first->second;
+        if (inserted.second)
+            entry.id = load();
+        ++entry.references;
+        return entry.id;
+    }
+
+    // drop one reference, deletes the texture with the last one
+    void release(const std::string& filename)
+    {
+        auto it = m_textures.find(normalize(filename));
+        if (it == m_textures.end())
+            return;
+        if (--it->second.references == 0)
+        {
+            glDeleteTextures(1, &it->second.id);
+            m_textures.erase(it);
+        }
+    }
+
+    size_t size() const { return m_textures.size(); }
+
+private:
+    struct Entry
+    {
+        unsigned int id = 0;
+        int references = 0;
+    };
+
+    std::unordered_map<std::string, Entry> m_textures;
+};
+
+#endif
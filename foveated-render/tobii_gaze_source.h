@@ -0,0 +1,46 @@
+#ifndef TOBII_GAZE_SOURCE_H
+#define TOBII_GAZE_SOURCE_H
+
+#include <tobii_gameintegration.h>
+
+#include <cmath>
+
+#include "gaze_source.h"
+
+// Live gaze from the Tobii game integration API. The API buffers the points
+// received since the previous Update(), so every tracker sample is delivered
+// with its own timestamp however often poll() runs.
+class TobiiGazeSource : public GazeSource
+{
+public:
+    explicit TobiiGazeSource(TobiiGameIntegration::ITobiiGameIntegrationApi* api)
+        : m_api(api), m_streamsProvider(api->GetStreamsProvider())
+    {
+    }
+
+    void poll(GazeSink& sink) override
+    {
+        m_api->Update();
+
+        const TobiiGameIntegration::GazePoint* gazePoints = nullptr;
+        int count = m_streamsProvider->GetGazePoints(gazePoints);
+        if (gazePoints == nullptr)
+            return;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const TobiiGameIntegration::GazePoint& point = gazePoints[i];
+            GazeSample sample = { point.TimeStampMicroSeconds, point.X, point.Y,
+                std::isfinite(point.X) && std::isfinite(point.Y) };
+            sink.push(sample);
+        }
+    }
+
+    const char* name() const override { return "Tobii"; }
+
+private:
+    TobiiGameIntegration::ITobiiGameIntegrationApi* m_api;
+    TobiiGameIntegration::IStreamsProvider* m_streamsProvider;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small pool of persistent worker threads. run() hands out task indices
+// [0, taskCount) to the workers and the calling thread alike and returns once
+// every task has finished, so no threads are created or destroyed per call.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned threadCount)
+    {
+        for (unsigned i = 0; i < threadCount; ++i)
+            m_threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // number of threads that execute tasks, including the caller of run()
+    unsigned concurrency() const
+    {
+        return (unsigned)m_threads.size() + 1;
+    }
+
+    // call task(index) for every index in [0, taskCount), blocks until all are done
+    template <typename Task>
+    void run(int taskCount, Task& task)
+    {
+        if (taskCount <= 0)
+            return;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_context = &task;
+        m_invoke = [](void* context, int index) { (*static_cast<Task*>(context))(index); };
+        m_count = taskCount;
+        m_next = 0;
+        m_finished = 0;
+        ++m_generation;
+        lock.unlock();
+        m_wake.notify_all();
+
+        lock.lock();
+        drain(lock);
+        m_done.wait(lock, [this] { return m_finished == m_count; });
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stop = false;
+    uint64_t m_generation = 0;
+
+    void* m_context = nullptr;
+    void (*m_invoke)(void*, int) = nullptr;
+    int m_count = 0;
+    int m_next = 0;
+    int m_finished = 0;
+
+    // claim and execute tasks until none are left, called with the lock held
+    void drain(std::unique_lock<std::mutex>& lock)
+    {
+        while (m_next < m_count)
+        {
+            int index = m_next++;
+            void* context = m_context;
+            void (*invoke)(void*, int) = m_invoke;
+
+            lock.unlock();
+            invoke(context, index);
+            lock.lock();
+
+            if (++m_finished == m_count)
+                m_done.notify_all();
+        }
+    }
+
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint64_t seen = 0;
+        for (;;)
+        {
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop)
+                return;
+            seen = m_generation;
+            drain(lock);
+        }
+    }
+};
+
+#endif